@@ -3,11 +3,92 @@
 #include <memory>
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
+#include <charconv>
+#include <cerrno>
+#include <unistd.h>
+
+// Приёмник отрисовки: глифы пишут текст сюда, а не в std::cout
+// Дословная копия RenderSink и FdRenderSink; каноническая копия - в
+// 1_Стратегия/main.cpp (примеры собираются по одному файлу). Правки
+// вносятся там и переносятся во все копии.
+class RenderSink {
+    public:
+        virtual void Write(const char* data, size_t size) = 0;
+        virtual void Flush() {}
+        virtual ~RenderSink() = default;
+
+        RenderSink& operator<<(const char* text) {
+            Write(text, std::strlen(text));
+            return *this;
+        }
+
+        RenderSink& operator<<(char ch) {
+            Write(&ch, 1);
+            return *this;
+        }
+
+        RenderSink& operator<<(size_t value) {
+            char digits[20];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            Write(digits, result.ptr - digits);
+            return *this;
+        }
+};
+
+// Копит вывод в большом буфере и отдаёт его одним write(2), когда буфер
+// заполнен, при Flush() и в деструкторе - без сброса на каждый глиф
+class FdRenderSink : public RenderSink {
+    private:
+        int fd;
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        void writeAll(const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                data += written;
+                size -= written;
+            }
+        }
+
+    public:
+        explicit FdRenderSink(int fd = STDOUT_FILENO, size_t capacity = 1 << 16)
+            : fd(fd), buffer(capacity) {}
+
+        void Write(const char* data, size_t size) override {
+            if (used + size > buffer.size()) {
+                Flush();
+                if (size >= buffer.size()) {
+                    writeAll(data, size);
+                    return;
+                }
+            }
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        void Flush() override {
+            writeAll(buffer.data(), used);
+            used = 0;
+        }
+
+        ~FdRenderSink() {
+            Flush();
+        }
+};
+
 // Базовый класс графического объекта
 class Graphic {
 public:
     virtual ~Graphic() = default;
-    virtual void Draw() const = 0;
+    virtual void Draw(RenderSink& sink) const = 0;
     
     // Методы для работы с детьми (реализованы только в композите)
     virtual void Add(std::shared_ptr<Graphic> g) {
@@ -26,29 +107,29 @@ public:
 // Листовые объекты
 class Line : public Graphic {
 public:
-    void Draw() const override {
-        std::cout << "Рисуем линию\n";
+    void Draw(RenderSink& sink) const override {
+        sink << "Рисуем линию\n";
     }
 };
 
 class Rectangle : public Graphic {
 public:
-    void Draw() const override {
-        std::cout << "Рисуем прямоугольник\n";
+    void Draw(RenderSink& sink) const override {
+        sink << "Рисуем прямоугольник\n";
     }
 };
 
 class Text : public Graphic {
 public:
-    void Draw() const override {
-        std::cout << "Выводим текст\n";
+    void Draw(RenderSink& sink) const override {
+        sink << "Выводим текст\n";
     }
 };
 
 class Picture : public Graphic {
 public:
-    void Draw() const override {
-        std::cout << "Отображаем изображение\n";
+    void Draw(RenderSink& sink) const override {
+        sink << "Отображаем изображение\n";
     }
 };
 
@@ -57,12 +138,12 @@ class GraphicsGroup : public Graphic {
     std::vector<std::shared_ptr<Graphic>> children;
     
 public:
-    void Draw() const override {
-        std::cout << "=== Начало группы ===\n";
+    void Draw(RenderSink& sink) const override {
+        sink << "=== Начало группы ===\n";
         for (const auto& child : children) {
-            child->Draw();
+            child->Draw(sink);
         }
-        std::cout << "=== Конец группы ===\n\n";
+        sink << "=== Конец группы ===\n\n";
     }
     
     void Add(std::shared_ptr<Graphic> g) override {
@@ -85,6 +166,7 @@ public:
 };
 
 int main() {
+    FdRenderSink out;
     try {
         // Создаем листовые объекты
         auto line = std::make_shared<Line>();
@@ -108,17 +190,18 @@ int main() {
         root->Add(std::make_shared<Line>());  // Добавляем отдельный элемент
 
         // Демонстрация работы
-        std::cout << "Рисуем корневую группу:\n";
-        root->Draw();
+        out << "Рисуем корневую группу:\n";
+        root->Draw(out);
 
         // Тестирование методов
-        std::cout << "Первый элемент корневой группы:\n";
-        root->GetChild(0)->Draw();
+        out << "Первый элемент корневой группы:\n";
+        root->GetChild(0)->Draw(out);
 
         // Попытка добавить элемент к примитиву
         line->Add(rect);  // Выбросит исключение
     }
     catch (const std::exception& e) {
+        out.Flush();
         std::cerr << "Ошибка: " << e.what() << std::endl;
     }
 
@@ -1,105 +1,1171 @@
 #include <iostream>
+#include <fstream>
 #include <vector>
+#include <limits>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <variant>
+#include <charconv>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+// Приёмник отрисовки: глифы пишут текст сюда, а не в std::cout
+// Каноническая копия RenderSink и FdRenderSink. Дословные копии лежат в
+// 2_Декоратор, 6_Итератор и 13_Компоновщик (примеры собираются по
+// одному файлу): правка вносится здесь и переносится во все копии.
+class RenderSink {
+    public:
+        virtual void Write(const char* data, size_t size) = 0;
+        virtual void Flush() {}
+        virtual ~RenderSink() = default;
+
+        RenderSink& operator<<(const char* text) {
+            Write(text, std::strlen(text));
+            return *this;
+        }
+
+        RenderSink& operator<<(char ch) {
+            Write(&ch, 1);
+            return *this;
+        }
+
+        RenderSink& operator<<(size_t value) {
+            char digits[20];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            Write(digits, result.ptr - digits);
+            return *this;
+        }
+};
+
+// Копит вывод в большом буфере и отдаёт его одним write(2), когда буфер
+// заполнен, при Flush() и в деструкторе - без сброса на каждый глиф
+class FdRenderSink : public RenderSink {
+    private:
+        int fd;
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        void writeAll(const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                data += written;
+                size -= written;
+            }
+        }
+
+    public:
+        explicit FdRenderSink(int fd = STDOUT_FILENO, size_t capacity = 1 << 16)
+            : fd(fd), buffer(capacity) {}
+
+        void Write(const char* data, size_t size) override {
+            if (used + size > buffer.size()) {
+                Flush();
+                if (size >= buffer.size()) {
+                    writeAll(data, size);
+                    return;
+                }
+            }
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        void Flush() override {
+            writeAll(buffer.data(), used);
+            used = 0;
+        }
+
+        ~FdRenderSink() {
+            Flush();
+        }
+};
+
 class Glyph {
     public:
-        virtual void Draw() = 0;
+        virtual void Draw(RenderSink& sink) = 0;
+        virtual int Width() const = 0;
+        // Стоимость разрыва строки после глифа (kForbidBreak - разрыв запрещён)
+        virtual double Penalty() const { return 0; }
+        virtual bool EndsParagraph() const { return false; }
         virtual ~Glyph() = default;
 };
 
+const double kForbidBreak = std::numeric_limits<double>::infinity();
+
+// Результат компоновки: индексы глифов, на которых заканчиваются строки
+// (последний элемент всегда равен числу глифов)
+using LineBreaks = std::vector<size_t>;
+
 class Compositor {
     public:
-        virtual void Compose() = 0;
+        virtual LineBreaks Compose(const int* widths, const double* penalties,
+                                   size_t count, int lineWidth) = 0;
+        virtual const char* Name() const = 0;
         virtual ~Compositor() = default;
 
 };
 
-class ArrayCompositor : public Compositor {
+// Фиксированное число глифов в строке
+class ArrayCompositor final : public Compositor {
+    private:
+        size_t interval;
+
+    public:
+        ArrayCompositor(size_t interval = 8) : interval(interval ? interval : 1) {}
+
+        LineBreaks Compose(const int*, const double*, size_t count, int) override {
+            LineBreaks breaks;
+            breaks.reserve(count / interval + 1);
+            for (size_t end = interval; end < count; end += interval) {
+                breaks.push_back(end);
+            }
+            breaks.push_back(count);
+            return breaks;
+        }
+
+        const char* Name() const override { return "ArrayCompositor"; }
+};
+
+// Алгоритм Кнута-Пласса: минимизация суммарной "плохости" всех строк абзаца.
+// Стоимость строки выпукла по её длине, поэтому матрица стоимостей
+// монжева и оптимальная точка предыдущего разрыва монотонна - это даёт
+// O(n log n) вместо наивного O(n^2) перебора.
+class TeXCompositor final : public Compositor{
+    private:
+        static constexpr double kOverfullWeight = 1e9;
+
+        static double LineCost(long long length, int lineWidth) {
+            double slack = double(lineWidth) - double(length);
+            return slack >= 0 ? slack * slack : kOverfullWeight * slack * slack;
+        }
+
     public:
-        void Compose() override {
-            std::cout << "ArrayCompositor makes some changes!";
+        LineBreaks Compose(const int* widths, const double* penalties,
+                           size_t count, int lineWidth) override {
+            if (count == 0) {
+                return LineBreaks{0};
+            }
+            const double inf = std::numeric_limits<double>::infinity();
+
+            std::vector<long long> prefix(count + 1, 0);
+            for (size_t i = 0; i < count; i++) {
+                prefix[i + 1] = prefix[i] + widths[i];
+            }
+            // cost[j] - минимальная стоимость разбиения первых j глифов,
+            // from[j] - начало последней строки в этом разбиении
+            std::vector<double> cost(count + 1, inf);
+            std::vector<size_t> from(count + 1, 0);
+            cost[0] = 0;
+
+            auto value = [&](size_t i, size_t j) {
+                return cost[i] + LineCost(prefix[j] - prefix[i], lineWidth);
+            };
+
+            // Очередь кандидатов: candidate[k] оптимален для j из [start[k], start[k + 1])
+            std::vector<size_t> candidate{0};
+            std::vector<size_t> start{1};
+            size_t head = 0;
+
+            for (size_t j = 1; j < count; j++) {
+                while (head + 1 < candidate.size() && start[head + 1] <= j) {
+                    head++;
+                }
+                double penalty = penalties[j - 1];
+                if (penalty == kForbidBreak) {
+                    continue;
+                }
+                size_t i = candidate[head];
+                cost[j] = value(i, j) + penalty;
+                from[j] = i;
+
+                // Новый кандидат j вытесняет старых, начиная с некоторой позиции
+                while (candidate.size() > head) {
+                    size_t at = std::max(start.back(), j + 1);
+                    if (at < count && value(j, at) <= value(candidate.back(), at)
+                        && candidate.size() - 1 > head) {
+                        candidate.pop_back();
+                        start.pop_back();
+                        continue;
+                    }
+                    break;
+                }
+                size_t lo = std::max(start.back(), j + 1);
+                size_t hi = count;
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (value(j, mid) <= value(candidate.back(), mid)) {
+                        hi = mid;
+                    } else {
+                        lo = mid + 1;
+                    }
+                }
+                if (lo < count) {
+                    candidate.push_back(j);
+                    start.push_back(lo);
+                }
+            }
+
+            // Последняя строка абзаца не штрафуется за недозаполненность
+            for (size_t i = 0; i < count; i++) {
+                if (cost[i] == inf) {
+                    continue;
+                }
+                long long length = prefix[count] - prefix[i];
+                double last = cost[i] + (length <= lineWidth ? 0 : LineCost(length, lineWidth));
+                if (last <= cost[count]) {
+                    cost[count] = last;
+                    from[count] = i;
+                }
+            }
+
+            LineBreaks breaks;
+            for (size_t j = count; j > 0; j = from[j]) {
+                breaks.push_back(j);
+            }
+            return LineBreaks(breaks.rbegin(), breaks.rend());
+        }
+
+        const char* Name() const override { return "TeXCompositor"; }
+};
+
+// Жадная компоновка: строка заполняется, пока следующий глиф помещается
+class SimpleCompositor final : public Compositor {
+    public:
+        LineBreaks Compose(const int* widths, const double* penalties,
+                           size_t count, int lineWidth) override {
+            LineBreaks breaks;
+            long long length = 0;
+            size_t lineStart = 0;
+            size_t lastBreak = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (length + widths[i] > lineWidth && i > lineStart) {
+                    size_t end = lastBreak > lineStart ? lastBreak : i;
+                    breaks.push_back(end);
+                    lineStart = end;
+                    length = 0;
+                    for (size_t k = end; k < i; k++) {
+                        length += widths[k];
+                    }
+                }
+                length += widths[i];
+                if (penalties[i] != kForbidBreak) {
+                    lastBreak = i + 1;
+                }
+            }
+            breaks.push_back(count);
+            return breaks;
         }
+
+        const char* Name() const override { return "SimpleCompositor"; }
 };
 
-class TeXCompositor : public Compositor{
+// Пул потоков с перехватом работы: диапазон индексов режется на куски,
+// каждый поток берёт куски из своей очереди с конца, а опустев - крадёт
+// из чужих с начала. Так неравные по размеру абзацы не простаивают ядра.
+class WorkStealingPool {
+    private:
+        // Кусок несёт свою задачу: опоздавший поток не выполнит его чужой
+        struct Range {
+            size_t begin;
+            size_t end;
+            const std::function<void(size_t)>* job;
+        };
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Range> ranges;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex jobMutex;
+        std::condition_variable wake;
+        size_t generation = 0;
+        bool stopping = false;
+        std::atomic<size_t> remaining{0};
+
+        bool popOwn(size_t self, Range& range) {
+            Queue& queue = *queues[self];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.ranges.empty()) {
+                return false;
+            }
+            range = queue.ranges.back();
+            queue.ranges.pop_back();
+            return true;
+        }
+
+        bool steal(size_t self, Range& range) {
+            for (size_t k = 1; k < queues.size(); k++) {
+                Queue& queue = *queues[(self + k) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.ranges.empty()) {
+                    range = queue.ranges.front();
+                    queue.ranges.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void drain(size_t self) {
+            Range range;
+            while (popOwn(self, range) || steal(self, range)) {
+                for (size_t i = range.begin; i < range.end; i++) {
+                    (*range.job)(i);
+                }
+                remaining.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+
+        void workerLoop(size_t self) {
+            size_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(jobMutex);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping) {
+                        return;
+                    }
+                    seen = generation;
+                }
+                drain(self);
+            }
+        }
+
     public:
-        void Compose() override {
-            std::cout << "TeXCompositor makes some changes!";
+        explicit WorkStealingPool(size_t threads) {
+            threads = std::max<size_t>(threads, 1);
+            for (size_t i = 0; i < threads; i++) {
+                queues.push_back(std::make_unique<Queue>());
+            }
+            // Вызывающий поток работает за очередь 0
+            for (size_t i = 1; i < threads; i++) {
+                workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+            }
+        }
+
+        size_t size() const {
+            return queues.size();
         }
+
+        // Вызывает job(i) для всех i из [0, count) и дожидается завершения
+        void ParallelFor(size_t count, const std::function<void(size_t)>& job) {
+            if (count == 0) {
+                return;
+            }
+            size_t chunks = std::min(count, queues.size() * 8);
+            size_t chunkSize = (count + chunks - 1) / chunks;
+            chunks = (count + chunkSize - 1) / chunkSize;
+            remaining.store(chunks, std::memory_order_relaxed);
+            for (size_t c = 0; c < chunks; c++) {
+                Queue& queue = *queues[c % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.ranges.push_back({c * chunkSize, std::min(count, (c + 1) * chunkSize), &job});
+            }
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                generation++;
+            }
+            wake.notify_all();
+            drain(0);
+            while (remaining.load(std::memory_order_acquire) != 0) {
+                std::this_thread::yield();
+            }
+        }
+
+        ~WorkStealingPool() {
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+};
+
+// Абзац хранит собственные глифы, их метрики и кэш разрывов строк, поэтому
+// правка затрагивает только свой абзац
+struct Paragraph {
+    std::vector<Glyph*> glyphs;
+    std::vector<int> widths;
+    std::vector<double> penalties;
+    LineBreaks lineBreaks;
+    bool dirty = false;
+
+    void insert(size_t offset, Glyph* glyph) {
+        glyphs.insert(glyphs.begin() + offset, glyph);
+        widths.insert(widths.begin() + offset, glyph->Width());
+        penalties.insert(penalties.begin() + offset, glyph->Penalty());
+    }
+
+    void erase(size_t offset) {
+        glyphs.erase(glyphs.begin() + offset);
+        widths.erase(widths.begin() + offset);
+        penalties.erase(penalties.begin() + offset);
+    }
+
+    // Переносит в новый абзац глифы, начиная с offset
+    Paragraph splitAt(size_t offset) {
+        Paragraph tail;
+        tail.glyphs.assign(glyphs.begin() + offset, glyphs.end());
+        tail.widths.assign(widths.begin() + offset, widths.end());
+        tail.penalties.assign(penalties.begin() + offset, penalties.end());
+        glyphs.resize(offset);
+        widths.resize(offset);
+        penalties.resize(offset);
+        return tail;
+    }
+
+    void append(const Paragraph& other) {
+        glyphs.insert(glyphs.end(), other.glyphs.begin(), other.glyphs.end());
+        widths.insert(widths.end(), other.widths.begin(), other.widths.end());
+        penalties.insert(penalties.end(), other.penalties.begin(), other.penalties.end());
+    }
 };
 
-class SimpleCompositor : public Compositor {
+// Список абзацев в виде неявного декартова дерева: ключ узла - его номер
+// по порядку, приоритеты случайны, поэтому глубина в среднем O(log P).
+// Узел хранит число абзацев и глифов своего поддерева, так что поиск абзаца
+// по номеру или по позиции глифа, вставка и удаление абзаца стоят O(log P)
+// и не сдвигают соседей. Узлы не перемещаются в памяти, поэтому указатель
+// на узел остаётся действительным, пока абзац существует.
+class ParagraphTree {
+    public:
+        struct Node {
+            Paragraph paragraph;
+            Node* left = nullptr;
+            Node* right = nullptr;
+            Node* parent = nullptr;
+            uint32_t priority = 0;
+            // Абзацы и глифы поддерева вместе с самим узлом
+            size_t subtreeParagraphs = 1;
+            size_t subtreeGlyphs = 0;
+        };
+
+    private:
+        Node* root = nullptr;
+        std::mt19937 rng{0x5eed};
+
+        static size_t paragraphsIn(const Node* node) {
+            return node ? node->subtreeParagraphs : 0;
+        }
+
+        static size_t glyphsIn(const Node* node) {
+            return node ? node->subtreeGlyphs : 0;
+        }
+
+        static void pull(Node* node) {
+            node->subtreeParagraphs = 1 + paragraphsIn(node->left) + paragraphsIn(node->right);
+            node->subtreeGlyphs = node->paragraph.glyphs.size() + glyphsIn(node->left) + glyphsIn(node->right);
+            if (node->left) {
+                node->left->parent = node;
+            }
+            if (node->right) {
+                node->right->parent = node;
+            }
+        }
+
+        static Node* merge(Node* a, Node* b) {
+            if (!a || !b) {
+                return a ? a : b;
+            }
+            if (a->priority > b->priority) {
+                a->right = merge(a->right, b);
+                pull(a);
+                return a;
+            }
+            b->left = merge(a, b->left);
+            pull(b);
+            return b;
+        }
+
+        // Первые count абзацев уходят в a, остальные в b
+        static void split(Node* node, size_t count, Node*& a, Node*& b) {
+            if (!node) {
+                a = b = nullptr;
+                return;
+            }
+            node->parent = nullptr;
+            if (paragraphsIn(node->left) < count) {
+                split(node->right, count - paragraphsIn(node->left) - 1, node->right, b);
+                a = node;
+            } else {
+                split(node->left, count, a, node->left);
+                b = node;
+            }
+            pull(node);
+        }
+
+        void setRoot(Node* node) {
+            root = node;
+            if (root) {
+                root->parent = nullptr;
+            }
+        }
+
+        static void destroy(Node* node) {
+            if (node) {
+                destroy(node->left);
+                destroy(node->right);
+                delete node;
+            }
+        }
+
+        template <typename F>
+        static void visit(Node* node, F& f) {
+            if (node) {
+                visit(node->left, f);
+                f(node);
+                visit(node->right, f);
+            }
+        }
+
     public:
-        void Compose() override {
-            std::cout << "SimpleCompositor makes some changes!";
+        ParagraphTree() = default;
+        ParagraphTree(const ParagraphTree&) = delete;
+        ParagraphTree& operator=(const ParagraphTree&) = delete;
+
+        size_t size() const {
+            return paragraphsIn(root);
+        }
+
+        size_t glyphCount() const {
+            return glyphsIn(root);
+        }
+
+        Node* at(size_t index) const {
+            Node* node = root;
+            while (node) {
+                size_t left = paragraphsIn(node->left);
+                if (index < left) {
+                    node = node->left;
+                } else if (index == left) {
+                    return node;
+                } else {
+                    index -= left + 1;
+                    node = node->right;
+                }
+            }
+            return nullptr;
+        }
+
+        // Абзац, содержащий глиф position; position становится смещением в нём
+        Node* locate(size_t& position) const {
+            Node* node = root;
+            while (node) {
+                size_t left = glyphsIn(node->left);
+                size_t own = node->paragraph.glyphs.size();
+                if (position < left) {
+                    node = node->left;
+                } else if (position < left + own || !node->right) {
+                    position -= left;
+                    return node;
+                } else {
+                    position -= left + own;
+                    node = node->right;
+                }
+            }
+            return nullptr;
+        }
+
+        size_t indexOf(const Node* node) const {
+            size_t index = paragraphsIn(node->left);
+            for (; node->parent; node = node->parent) {
+                if (node->parent->right == node) {
+                    index += paragraphsIn(node->parent->left) + 1;
+                }
+            }
+            return index;
+        }
+
+        Node* next(const Node* node) const {
+            if (node->right) {
+                Node* next = node->right;
+                while (next->left) {
+                    next = next->left;
+                }
+                return next;
+            }
+            while (node->parent && node->parent->right == node) {
+                node = node->parent;
+            }
+            return node->parent;
+        }
+
+        // Вставляет абзац под номером index и возвращает его узел
+        Node* insert(size_t index, Paragraph paragraph) {
+            Node* node = new Node;
+            node->paragraph = std::move(paragraph);
+            node->priority = static_cast<uint32_t>(rng());
+            pull(node);
+            Node* a;
+            Node* b;
+            split(root, index, a, b);
+            setRoot(merge(merge(a, node), b));
+            return node;
+        }
+
+        void erase(Node* node) {
+            Node* a;
+            Node* rest;
+            Node* middle;
+            Node* b;
+            split(root, indexOf(node), a, rest);
+            split(rest, 1, middle, b);
+            delete middle;
+            setRoot(merge(a, b));
+        }
+
+        // Пересчитывает суммы предков после правки глифов абзаца
+        void resized(Node* node) {
+            for (; node; node = node->parent) {
+                pull(node);
+            }
+        }
+
+        // Обходит абзацы по порядку
+        template <typename F>
+        void forEach(F f) const {
+            visit(root, f);
+        }
+
+        ~ParagraphTree() {
+            destroy(root);
         }
 };
 
-class Composition {
+// Все абзацы, кроме последнего, заканчиваются глифом с EndsParagraph().
+// Правки помечают абзацы грязными, Repair() перекомпоновывает только их.
+// CompositorT задаёт стратегию во время компиляции: для final-класса
+// вызов Compose разрешается статически и встраивается, а Composition
+// с базовым Compositor сохраняет выбор стратегии во время выполнения.
+template <typename CompositorT = Compositor>
+class BasicComposition {
     private:
-        Compositor * compositor;
-        std::vector<Glyph*> glyphs;
-    
+        using Node = ParagraphTree::Node;
+
+        CompositorT * compositor;
+        // Разбиение и слияние абзацев стоят O(log P), и грязные абзацы
+        // хранятся узлами, а не номерами, поэтому их не надо сдвигать
+        ParagraphTree paragraphs;
+        std::vector<Node*> dirtyParagraphs;
+        WorkStealingPool* pool = nullptr;
+        int lineWidth;
+
+        void markDirty(Node* node) {
+            if (!node->paragraph.dirty) {
+                node->paragraph.dirty = true;
+                dirtyParagraphs.push_back(node);
+            }
+        }
+
+        void markAllDirty() {
+            paragraphs.forEach([this](Node* node) { markDirty(node); });
+        }
+
+        // Абзац, содержащий глиф position, и смещение глифа в нём.
+        // Позиция за последним глифом относится к последнему абзацу.
+        std::pair<Node*, size_t> locate(size_t position) const {
+            if (position >= paragraphs.glyphCount()) {
+                Node* last = paragraphs.at(paragraphs.size() - 1);
+                return {last, last->paragraph.glyphs.size()};
+            }
+            Node* node = paragraphs.locate(position);
+            return {node, position};
+        }
+
+        void splitParagraph(Node* node, size_t offset) {
+            Paragraph tail = node->paragraph.splitAt(offset);
+            paragraphs.resized(node);
+            markDirty(paragraphs.insert(paragraphs.indexOf(node) + 1, std::move(tail)));
+        }
+
+        void mergeWithNext(Node* node, Node* next) {
+            if (next->paragraph.dirty) {
+                dirtyParagraphs.erase(std::find(dirtyParagraphs.begin(), dirtyParagraphs.end(), next));
+            }
+            node->paragraph.append(next->paragraph);
+            paragraphs.erase(next);
+            paragraphs.resized(node);
+        }
+
     public:
-        Composition(Compositor * c) : compositor(c){}
+        BasicComposition(CompositorT * c, int lineWidth = 80) : compositor(c), lineWidth(lineWidth){
+            paragraphs.insert(0, Paragraph());
+        }
 
         void addGlyph(Glyph*glyph) {
-            glyphs.push_back(glyph);
+            insertGlyph(paragraphs.glyphCount(), glyph);
         }
 
-        void Draw() {
-            for (auto glyph: glyphs){
-                glyph->Draw();
+        void insertGlyph(size_t position, Glyph* glyph) {
+            auto [node, offset] = locate(position);
+            node->paragraph.insert(offset, glyph);
+            paragraphs.resized(node);
+            markDirty(node);
+            if (glyph->EndsParagraph()) {
+                splitParagraph(node, offset + 1);
             }
-            compositor->Compose();
         }
 
-        void setCompositor(Compositor*c) {
-            compositor = c;
+        void removeGlyph(size_t position) {
+            if (position >= paragraphs.glyphCount()) {
+                return;
+            }
+            auto [node, offset] = locate(position);
+            Glyph* glyph = node->paragraph.glyphs[offset];
+            node->paragraph.erase(offset);
+            paragraphs.resized(node);
+            markDirty(node);
+            if (glyph->EndsParagraph()) {
+                if (Node* next = paragraphs.next(node)) {
+                    mergeWithNext(node, next);
+                }
+            }
+            delete glyph;
         }
 
-        ~Composition() {
-            for (auto glyph : glyphs){
-                delete glyph;
+    private:
+        void drawParagraph(RenderSink& sink, size_t p, const Paragraph& paragraph) const {
+            if (paragraph.glyphs.empty()) {
+                return;
+            }
+            for (auto glyph: paragraph.glyphs){
+                glyph->Draw(sink);
             }
+            sink << compositor->Name() << " breaks paragraph " << p << " at:";
+            for (size_t end : paragraph.lineBreaks) {
+                sink << ' ' << end;
+            }
+            sink << '\n';
+        }
+
+    public:
+        // Перекомпоновывает грязные абзацы и возвращает их номера по порядку
+        std::vector<size_t> Repair() {
+            std::vector<std::pair<size_t, Node*>> repaired;
+            repaired.reserve(dirtyParagraphs.size());
+            if (dirtyParagraphs.size() * 16 < paragraphs.size()) {
+                for (Node* node : dirtyParagraphs) {
+                    repaired.emplace_back(paragraphs.indexOf(node), node);
+                }
+                std::sort(repaired.begin(), repaired.end());
+            } else {
+                // Грязных много: один обход по порядку дешевле поиска номера для каждого
+                size_t index = 0;
+                paragraphs.forEach([&](Node* node) {
+                    if (node->paragraph.dirty) {
+                        repaired.emplace_back(index, node);
+                    }
+                    index++;
+                });
+            }
+            dirtyParagraphs.clear();
+            // Абзацы компонуются независимо, каждый пишет только свой кэш
+            std::function<void(size_t)> compose = [&](size_t k) {
+                Paragraph& paragraph = repaired[k].second->paragraph;
+                paragraph.lineBreaks = compositor->Compose(paragraph.widths.data(),
+                                                           paragraph.penalties.data(),
+                                                           paragraph.glyphs.size(), lineWidth);
+                paragraph.dirty = false;
+            };
+            if (pool && repaired.size() > 1) {
+                pool->ParallelFor(repaired.size(), compose);
+            } else {
+                for (size_t k = 0; k < repaired.size(); k++) {
+                    compose(k);
+                }
+            }
+            std::vector<size_t> indices(repaired.size());
+            for (size_t k = 0; k < repaired.size(); k++) {
+                indices[k] = repaired[k].first;
+            }
+            return indices;
+        }
+
+        // Перекомпоновывает грязные абзацы и рисует весь документ
+        void Draw(RenderSink& sink) {
+            Repair();
+            size_t p = 0;
+            paragraphs.forEach([&](const Node* node) {
+                drawParagraph(sink, p++, node->paragraph);
+            });
+        }
+
+        // Рисует только абзацы, изменившиеся с прошлой перекомпоновки
+        void DrawDamaged(RenderSink& sink) {
+            for (size_t p : Repair()) {
+                drawParagraph(sink, p, paragraphs.at(p)->paragraph);
+            }
+        }
+
+        // Разрывы строк всего документа в порядке следования абзацев
+        LineBreaks getDocumentLineBreaks() const {
+            LineBreaks breaks;
+            size_t offset = 0;
+            paragraphs.forEach([&](const Node* node) {
+                if (node->paragraph.glyphs.empty()) {
+                    return;
+                }
+                for (size_t end : node->paragraph.lineBreaks) {
+                    breaks.push_back(offset + end);
+                }
+                offset += node->paragraph.glyphs.size();
+            });
+            return breaks;
+        }
+
+        void setThreadPool(WorkStealingPool* p) {
+            pool = p;
+        }
+
+        size_t getParagraphCount() const {
+            return paragraphs.size();
+        }
+
+        // Разрывы строк абзаца относительно его первого глифа
+        const LineBreaks& getLineBreaks(size_t paragraph) const {
+            return paragraphs.at(paragraph)->paragraph.lineBreaks;
+        }
+
+        void setCompositor(CompositorT*c) {
+            if (compositor != c) {
+                compositor = c;
+                markAllDirty();
+            }
+        }
+
+        ~BasicComposition() {
+            paragraphs.forEach([](Node* node) {
+                for (auto glyph : node->paragraph.glyphs){
+                    delete glyph;
+                }
+            });
         }
 };
 
-class CircleGlyph : public Glyph {
+using Composition = BasicComposition<>;
+
+class CircleGlyph final : public Glyph {
 public:
-    void Draw() override {
-        std::cout << "Drawing a circle." << std::endl;
+    void Draw(RenderSink& sink) override {
+        sink << "Drawing a circle.\n";
     }
+
+    int Width() const override { return 10; }
 };
 
-class SquareGlyph : public Glyph {
+class SquareGlyph final : public Glyph {
 public:
-    void Draw() override {
-        std::cout << "Drawing a square." << std::endl;
+    void Draw(RenderSink& sink) override {
+        sink << "Drawing a square.\n";
     }
+
+    int Width() const override { return 12; }
 };
 
+// Конец абзаца: строки соседних абзацев компонуются независимо
+class ParagraphGlyph : public Glyph {
+public:
+    void Draw(RenderSink& sink) override {
+        sink << "Ending a paragraph.\n";
+    }
+
+    int Width() const override { return 0; }
+
+    bool EndsParagraph() const override { return true; }
+};
+
+
+
+// Замер времени компоновки документа из count глифов
+void RunBenchmark(size_t count) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> width(4, 16);
+    std::uniform_int_distribution<int> space(0, 5);
+    std::vector<int> widths(count);
+    std::vector<double> penalties(count);
+    for (size_t i = 0; i < count; i++) {
+        widths[i] = width(rng);
+        // Разрывы разрешены примерно после каждого шестого глифа (между "словами")
+        penalties[i] = space(rng) == 0 ? 0 : kForbidBreak;
+    }
+
+    ArrayCompositor arrayCompositor(40);
+    SimpleCompositor simpleCompositor;
+    TeXCompositor texCompositor;
+    Compositor* compositors[] = {&arrayCompositor, &simpleCompositor, &texCompositor};
+
+    std::cout << "Composing " << count << " glyphs:" << std::endl;
+    for (Compositor* compositor : compositors) {
+        auto begin = std::chrono::steady_clock::now();
+        LineBreaks breaks = compositor->Compose(widths.data(), penalties.data(), count, 400);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "  " << compositor->Name() << ": " << breaks.size() << " lines, "
+                  << std::chrono::duration<double, std::milli>(end - begin).count() << " ms"
+                  << std::endl;
+    }
+}
+
+// Задержка одной правки с перекомпоновкой на документах разного размера
+void RunEditBenchmark(size_t count, size_t paragraphSize) {
+    TeXCompositor texCompositor;
+    Composition composition(&texCompositor, 400);
+    for (size_t i = 0; i < count; i++) {
+        if (i % paragraphSize == paragraphSize - 1) {
+            composition.addGlyph(new ParagraphGlyph());
+        } else if (i % 2) {
+            composition.addGlyph(new CircleGlyph());
+        } else {
+            composition.addGlyph(new SquareGlyph());
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    composition.Repair();
+    auto end = std::chrono::steady_clock::now();
+    double full = std::chrono::duration<double, std::milli>(end - begin).count();
+
+    const size_t edits = 1000;
+    std::mt19937 rng(7);
+    begin = std::chrono::steady_clock::now();
+    for (size_t e = 0; e < edits; e++) {
+        size_t position = rng() % count;
+        composition.insertGlyph(position, new CircleGlyph());
+        composition.Repair();
+        composition.removeGlyph(position);
+        composition.Repair();
+    }
+    end = std::chrono::steady_clock::now();
+    double perEdit = std::chrono::duration<double, std::micro>(end - begin).count() / (2 * edits);
+
+    // Вставка и удаление конца абзаца: разбиение и слияние абзацев
+    begin = std::chrono::steady_clock::now();
+    for (size_t e = 0; e < edits; e++) {
+        size_t position = rng() % count;
+        composition.insertGlyph(position, new ParagraphGlyph());
+        composition.Repair();
+        composition.removeGlyph(position);
+        composition.Repair();
+    }
+    end = std::chrono::steady_clock::now();
+    double perBreak = std::chrono::duration<double, std::micro>(end - begin).count() / (2 * edits);
+
+    std::cout << count << " glyphs in " << composition.getParagraphCount() << " paragraphs: full "
+              << full << " ms, per edit " << perEdit << " us, per paragraph break "
+              << perBreak << " us" << std::endl;
+}
+
+// Масштабирование полной перекомпоновки по числу потоков
+void RunScalingBenchmark(size_t paragraphCount) {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<size_t> paragraphSize(10, 100);
+    TeXCompositor texCompositor;
+    SimpleCompositor simpleCompositor;
+    Composition composition(&texCompositor, 400);
+    size_t glyphs = 0;
+    for (size_t p = 0; p < paragraphCount; p++) {
+        size_t size = paragraphSize(rng);
+        for (size_t i = 0; i + 1 < size; i++) {
+            composition.addGlyph(i % 2 ? static_cast<Glyph*>(new CircleGlyph()) : new SquareGlyph());
+        }
+        composition.addGlyph(new ParagraphGlyph());
+        glyphs += size;
+    }
+    composition.Repair();
+    LineBreaks serial = composition.getDocumentLineBreaks();
+
+    std::cout << "Recomposing " << paragraphCount << " paragraphs (" << glyphs << " glyphs):" << std::endl;
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        WorkStealingPool pool(threads);
+        composition.setThreadPool(&pool);
+        // Смена компоновщика делает грязными все абзацы
+        composition.setCompositor(&simpleCompositor);
+        composition.setCompositor(&texCompositor);
+        auto begin = std::chrono::steady_clock::now();
+        composition.Repair();
+        auto end = std::chrono::steady_clock::now();
+        composition.setThreadPool(nullptr);
+        std::cout << "  " << threads << " threads: "
+                  << std::chrono::duration<double, std::milli>(end - begin).count() << " ms"
+                  << (composition.getDocumentLineBreaks() == serial ? "" : " (MISMATCH)") << std::endl;
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+}
+
+template <typename CompositionT, typename CompositorT>
+double TimeFullRepair(CompositionT& composition, CompositorT& first, CompositorT& second) {
+    composition.setCompositor(&second);
+    composition.Repair();
+    composition.setCompositor(&first);
+    auto begin = std::chrono::steady_clock::now();
+    composition.Repair();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+template <typename CompositionT>
+void FillShortParagraphs(CompositionT& composition, size_t paragraphCount) {
+    for (size_t p = 0; p < paragraphCount; p++) {
+        composition.addGlyph(new CircleGlyph());
+        composition.addGlyph(new SquareGlyph());
+        composition.addGlyph(new ParagraphGlyph());
+    }
+}
 
+// Виртуальная и статическая диспетчеризация на большом числе глифов
+void RunDispatchBenchmark(size_t count) {
+    SimpleCompositor first;
+    SimpleCompositor second;
 
+    Composition dynamicComposition(&first, 400);
+    FillShortParagraphs(dynamicComposition, count / 3);
+    double dynamicTime = TimeFullRepair(dynamicComposition, first, second);
 
+    BasicComposition<SimpleCompositor> staticComposition(&first, 400);
+    FillShortParagraphs(staticComposition, count / 3);
+    double staticTime = TimeFullRepair(staticComposition, first, second);
 
-int main() {
+    std::cout << "Composing " << count / 3 << " short paragraphs: virtual "
+              << dynamicTime << " ms, static " << staticTime << " ms" << std::endl;
+
+    // Метрики глифов: вызов через vtable против std::visit по значению
+    std::vector<Glyph*> pointers;
+    std::vector<std::variant<CircleGlyph, SquareGlyph>> values;
+    pointers.reserve(count);
+    values.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (i % 3) {
+            pointers.push_back(new CircleGlyph());
+            values.emplace_back(CircleGlyph());
+        } else {
+            pointers.push_back(new SquareGlyph());
+            values.emplace_back(SquareGlyph());
+        }
+    }
+    auto begin = std::chrono::steady_clock::now();
+    long long virtualWidth = 0;
+    for (Glyph* glyph : pointers) {
+        virtualWidth += glyph->Width();
+    }
+    auto middle = std::chrono::steady_clock::now();
+    long long staticWidth = 0;
+    for (const auto& glyph : values) {
+        staticWidth += std::visit([](const auto& g) { return g.Width(); }, glyph);
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (Glyph* glyph : pointers) {
+        delete glyph;
+    }
+
+    std::cout << "Measuring " << count << " glyphs: virtual "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, static "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms"
+              << (virtualWidth == staticWidth ? "" : " (MISMATCH)") << std::endl;
+}
+
+// Отрисовка через буферизованный приёмник против std::endl на каждый глиф
+void RunRenderBenchmark(size_t count) {
+    int fd = ::open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+    std::vector<Glyph*> glyphs;
+    for (size_t i = 0; i < count; i++) {
+        glyphs.push_back(i % 2 ? static_cast<Glyph*>(new CircleGlyph()) : new SquareGlyph());
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    {
+        FdRenderSink sink(fd);
+        for (Glyph* glyph : glyphs) {
+            glyph->Draw(sink);
+        }
+    }
+    auto middle = std::chrono::steady_clock::now();
+    {
+        // Прежняя схема: по одному сбросу потока на глиф
+        std::ofstream stream("/dev/null");
+        for (size_t i = 0; i < count; i++) {
+            stream << (i % 2 ? "Drawing a circle." : "Drawing a square.") << std::endl;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    ::close(fd);
+    for (Glyph* glyph : glyphs) {
+        delete glyph;
+    }
+
+    std::cout << "Drawing " << count << " glyphs: sink "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, std::endl "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        RunBenchmark(1000000);
+        RunBenchmark(4000000);
+        RunEditBenchmark(100000, 100);
+        RunEditBenchmark(1000000, 100);
+        RunScalingBenchmark(200000);
+        RunDispatchBenchmark(3000000);
+        RunRenderBenchmark(1000000);
+        return 0;
+    }
+
+    FdRenderSink out;
 
     SimpleCompositor simpleCompositor;
 
-    Composition composition(&simpleCompositor);
+    Composition composition(&simpleCompositor, 40);
 
     composition.addGlyph(new CircleGlyph());
     composition.addGlyph(new SquareGlyph());
-.
-    composition.Draw();
+    composition.addGlyph(new CircleGlyph());
+    composition.addGlyph(new SquareGlyph());
+    composition.addGlyph(new ParagraphGlyph());
+    composition.addGlyph(new CircleGlyph());
+
+    composition.Draw(out);
+
+    composition.insertGlyph(4, new SquareGlyph());
 
-    ArrayCompositor arrayCompositor;
+    // Перерисовывается только первый абзац, в который вставлен квадрат
+    composition.DrawDamaged(out);
+
+    ArrayCompositor arrayCompositor(2);
     composition.setCompositor(&arrayCompositor);
-    
-    composition.Draw();
 
-    std::cout << "\n";
+    composition.Draw(out);
+
+    TeXCompositor texCompositor;
+    composition.setCompositor(&texCompositor);
+
+    composition.Draw(out);
+
+    out << '\n';
 
 
     return 0;
-}
\ No newline at end of file
+}
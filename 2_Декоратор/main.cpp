@@ -1,59 +1,595 @@
 #include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include <cstring>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Приёмник отрисовки: глифы пишут текст сюда, а не в std::cout
+// Дословная копия RenderSink и FdRenderSink; каноническая копия - в
+// 1_Стратегия/main.cpp (примеры собираются по одному файлу). Правки
+// вносятся там и переносятся во все копии.
+class RenderSink {
+    public:
+        virtual void Write(const char* data, size_t size) = 0;
+        virtual void Flush() {}
+        virtual ~RenderSink() = default;
+
+        RenderSink& operator<<(const char* text) {
+            Write(text, std::strlen(text));
+            return *this;
+        }
+
+        RenderSink& operator<<(char ch) {
+            Write(&ch, 1);
+            return *this;
+        }
+
+        RenderSink& operator<<(size_t value) {
+            char digits[20];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            Write(digits, result.ptr - digits);
+            return *this;
+        }
+};
+
+// Копит вывод в большом буфере и отдаёт его одним write(2), когда буфер
+// заполнен, при Flush() и в деструкторе - без сброса на каждый глиф
+class FdRenderSink : public RenderSink {
+    private:
+        int fd;
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        void writeAll(const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                data += written;
+                size -= written;
+            }
+        }
+
+    public:
+        explicit FdRenderSink(int fd = STDOUT_FILENO, size_t capacity = 1 << 16)
+            : fd(fd), buffer(capacity) {}
+
+        void Write(const char* data, size_t size) override {
+            if (used + size > buffer.size()) {
+                Flush();
+                if (size >= buffer.size()) {
+                    writeAll(data, size);
+                    return;
+                }
+            }
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        void Flush() override {
+            writeAll(buffer.data(), used);
+            used = 0;
+        }
+
+        ~FdRenderSink() {
+            Flush();
+        }
+};
+
+// Собирает вывод в строку, чтобы его можно было воспроизвести позже
+class StringRenderSink : public RenderSink {
+    private:
+        std::string data;
+
+    public:
+        void Write(const char* text, size_t size) override {
+            data.append(text, size);
+        }
+
+        const std::string& str() const {
+            return data;
+        }
+
+        void clear() {
+            data.clear();
+        }
+};
+
+class Glyph;
+
+// Шаг плоского списка отрисовки: рисует собственное оформление глифа,
+// не заходя в обёрнутый компонент
+struct DrawOp {
+    void (*draw)(Glyph* glyph, RenderSink& sink);
+    Glyph* glyph;
+};
 
 class Glyph{
     public:
-        virtual void Draw() = 0;
+        virtual void Draw(RenderSink& sink) = 0;
+
+        // Декоратор возвращает обёрнутый компонент, остальные глифы - nullptr
+        virtual Glyph* GetComponent() const { return nullptr; }
+
+        // Отдаёт обёрнутый компонент, отвязывая его от себя
+        virtual Glyph* ReleaseComponent() { return nullptr; }
+
+        // Лист рисуется целиком одной операцией
+        virtual DrawOp GetDrawOp() { return {&DrawWhole, this}; }
+
+        // Вызывается, когда вид глифа или чего-то внутри него изменился
+        virtual void Invalidate() {}
+
+        // Сообщает глифу и всем, кто его оборачивает, об изменении вида
+        void Changed() {
+            for (Glyph* glyph = this; glyph; glyph = glyph->parent) {
+                glyph->Invalidate();
+            }
+        }
+
+        void SetParent(Glyph* glyph) {
+            parent = glyph;
+        }
+
+        // Глиф создан в GlyphArena: его разрушает арена, а не delete
+        bool InArena() const {
+            return inArena;
+        }
+
         virtual ~Glyph() = default;
+
+    private:
+        friend class GlyphArena;
+
+        Glyph* parent = nullptr;
+        bool inArena = false;
+
+        static void DrawWhole(Glyph* glyph, RenderSink& sink) {
+            glyph->Draw(sink);
+        }
 };
 
 class MonoGlyph : public Glyph {
     public:
-        virtual void Draw() override{
-           std::cout << "Drawing MonoGlyph" << std::endl; 
+        virtual void Draw(RenderSink& sink) override{
+           sink << "Drawing MonoGlyph\n"; 
         }
 };
 
 
-class Border : public Glyph {
-    private:
+class Decorator : public Glyph {
+    protected:
         Glyph * component;
 
     public:
-        Border(Glyph*comp) : component(comp){}
+        Decorator(Glyph*comp) : component(comp){
+            if (component) {
+                component->SetParent(this);
+            }
+        }
+
+        Glyph* GetComponent() const override {
+            return component;
+        }
 
-        void Draw() override {
-            component->Draw();
-            DrawBorder();
+        void SetComponent(Glyph*comp) {
+            component = comp;
+            if (component) {
+                component->SetParent(this);
+            }
+            Changed();
         }
 
-        void DrawBorder()  {
-            std::cout << "Drawing Border" << std::endl;
+        Glyph* ReleaseComponent() override {
+            Glyph* released = component;
+            component = nullptr;
+            if (released) {
+                released->SetParent(nullptr);
+            }
+            return released;
         }
 
-        ~Border() {
-            delete component; 
+        // Цепочка разбирается по одному звену, так что глубина стека
+        // не зависит от её длины. Разбор останавливается на глифе из арены:
+        // его и всё, что под ним, разрушит сама арена.
+        ~Decorator() {
+            Glyph* next = ReleaseComponent();
+            while (next && !next->InArena()) {
+                Glyph* inner = next->ReleaseComponent();
+                delete next;
+                next = inner;
+            }
         }
 };
 
-class Scroller : public Glyph {
-private:
-    Glyph* component;
+
+class Border : public Decorator {
+    public:
+        Border(Glyph*comp) : Decorator(comp){}
+
+        void Draw(RenderSink& sink) override {
+            component->Draw(sink);
+            DrawBorder(sink);
+        }
+
+        void DrawBorder(RenderSink& sink)  {
+            sink << "Drawing Border\n";
+        }
+
+        DrawOp GetDrawOp() override {
+            return {[](Glyph* glyph, RenderSink& sink) {
+                static_cast<Border*>(glyph)->DrawBorder(sink);
+            }, this};
+        }
+};
+
+class Scroller : public Decorator {
 public:
-    Scroller(Glyph* comp) : component(comp) {}
+    Scroller(Glyph* comp) : Decorator(comp) {}
 
-    void Draw() override {
-        component->Draw();
+    void Draw(RenderSink& sink) override {
+        component->Draw(sink);
         
-        std::cout << "Drawing Scroller" << std::endl;
+        DrawScroller(sink);
+    }
+
+    void DrawScroller(RenderSink& sink) {
+        sink << "Drawing Scroller\n";
     }
 
-    ~Scroller() {
-        delete component;
+    DrawOp GetDrawOp() override {
+        return {[](Glyph* glyph, RenderSink& sink) {
+            static_cast<Scroller*>(glyph)->DrawScroller(sink);
+        }, this};
     }
 };
 
+// Запоминает вывод компонента и воспроизводит его на следующих кадрах,
+// пока компонент не сообщит об изменении через Changed()
+class CachedGlyph : public Decorator {
+    private:
+        StringRenderSink cache;
+        bool valid = false;
+
+    public:
+        CachedGlyph(Glyph*comp) : Decorator(comp){}
+
+        void Draw(RenderSink& sink) override {
+            if (!valid) {
+                cache.clear();
+                component->Draw(cache);
+                valid = true;
+            }
+            sink.Write(cache.str().data(), cache.str().size());
+        }
+
+        void Invalidate() override {
+            valid = false;
+        }
+
+        // В плоском списке компонент рисуют его собственные операции
+        DrawOp GetDrawOp() override {
+            return {[](Glyph*, RenderSink&) {}, this};
+        }
+};
+
+// Лист с изменяемым содержимым
+class Label : public Glyph {
+    private:
+        std::string text;
+
+    public:
+        Label(std::string text) : text(std::move(text)) {}
+
+        void Draw(RenderSink& sink) override {
+            sink << "Drawing Label: " << text.c_str() << '\n';
+        }
+
+        void SetText(std::string value) {
+            text = std::move(value);
+            Changed();
+        }
+};
+
+// Арена для цепочек декораторов: звенья лежат подряд в крупных блоках и
+// освобождаются все разом. Деструкторы глифов вызывает Release(); глифы из
+// арены не удаляются через delete, а куча и арена могут оборачивать друг
+// друга: обычный декоратор не трогает звенья арены, а декоратор из арены
+// удаляет обёрнутые глифы из кучи. Арена должна пережить цепочки из кучи,
+// в которых есть её звенья.
+class GlyphArena {
+    private:
+        std::vector<std::unique_ptr<char[]>> blocks;
+        size_t blockSize;
+        size_t used;
+        // Созданные глифы в порядке создания, для деструкторов в Release()
+        std::vector<Glyph*> glyphs;
+
+        void* allocate(size_t size, size_t alignment) {
+            size_t offset = (used + alignment - 1) & ~(alignment - 1);
+            if (blocks.empty() || offset + size > blockSize) {
+                blocks.emplace_back(new char[std::max(blockSize, size)]);
+                offset = 0;
+            }
+            used = offset + size;
+            return blocks.back().get() + offset;
+        }
+
+    public:
+        explicit GlyphArena(size_t blockSize = 1 << 20) : blockSize(blockSize), used(0) {}
+
+        GlyphArena(const GlyphArena&) = delete;
+        GlyphArena& operator=(const GlyphArena&) = delete;
+
+        ~GlyphArena() {
+            Release();
+        }
+
+        template <typename T, typename... Args>
+        T* Create(Args&&... args) {
+            static_assert(std::is_base_of_v<Glyph, T>, "the arena holds glyphs only");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned glyph");
+            glyphs.reserve(glyphs.size() + 1);
+            T* glyph = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            glyph->inArena = true;
+            glyphs.push_back(glyph);
+            return glyph;
+        }
+
+        // Разрушает все глифы арены; первый блок остаётся для повторного
+        // использования. Сначала рвутся связи между звеньями арены, чтобы
+        // деструктор не обращался к уже разрушенному соседу в любом порядке.
+        void Release() {
+            for (Glyph* glyph : glyphs) {
+                Glyph* component = glyph->GetComponent();
+                if (component && component->InArena()) {
+                    glyph->ReleaseComponent();
+                }
+            }
+            for (size_t i = glyphs.size(); i > 0; i--) {
+                glyphs[i - 1]->~Glyph();
+            }
+            glyphs.clear();
+            if (blocks.size() > 1) {
+                blocks.resize(1);
+            }
+            used = 0;
+        }
+};
+
+// Цепочка декораторов, развёрнутая в непрерывный список операций: Draw
+// идёт по массиву без рекурсии. Декораторы, вставленные и удалённые через
+// этот класс, правят список на месте; любую другую правку цепочки
+// Changed() доносит сюда, и список собирается заново при следующем Draw.
+class FlattenedGlyph : public Glyph {
+    private:
+        Glyph * root;
+        // chain[0] - внешний декоратор, chain.back() - обёрнутый лист
+        std::vector<Glyph*> chain;
+        // ops[k] рисует chain[chain.size() - 1 - k]: изнутри наружу
+        std::vector<DrawOp> ops;
+        // Цепочку поменяли в обход InsertDecorator/RemoveDecorator
+        bool stale = false;
+
+        // Внешнее звено цепочки принадлежит плоскому глифу, поэтому
+        // Changed() изнутри доходит и до тех, кто оборачивает его самого
+        void relink(size_t depth, Glyph* glyph) {
+            if (depth == 0) {
+                root = glyph;
+                root->SetParent(this);
+            } else {
+                static_cast<Decorator*>(chain[depth - 1])->SetComponent(glyph);
+            }
+        }
+
+    public:
+        FlattenedGlyph(Glyph*root) : root(root) {
+            if (root) {
+                root->SetParent(this);
+            }
+            Compile();
+        }
+
+        void Invalidate() override {
+            stale = true;
+        }
+
+        void Compile() {
+            chain.clear();
+            for (Glyph* glyph = root; glyph; glyph = glyph->GetComponent()) {
+                chain.push_back(glyph);
+            }
+            ops.clear();
+            ops.reserve(chain.size());
+            for (size_t k = chain.size(); k > 0; k--) {
+                ops.push_back(chain[k - 1]->GetDrawOp());
+            }
+            stale = false;
+        }
+
+        void Draw(RenderSink& sink) override {
+            if (stale) {
+                Compile();
+            }
+            for (const DrawOp& op : ops) {
+                op.draw(op.glyph, sink);
+            }
+        }
+
+        size_t Depth() {
+            if (stale) {
+                Compile();
+            }
+            return chain.size();
+        }
+
+        // Оборачивает глиф на глубине depth (0 - весь глиф) новым декоратором.
+        // Декоратор должен быть пустым: чужой компонент затёрся бы и утёк.
+        // При false декоратор остаётся у вызывающего.
+        bool InsertDecorator(size_t depth, Decorator* decorator) {
+            if (stale) {
+                Compile();
+            }
+            if (depth >= chain.size() || decorator->GetComponent()) {
+                return false;
+            }
+            // Новое звено ещё ни во что не вставлено: Changed() из
+            // SetComponent не должен уйти по прежнему родителю
+            decorator->SetParent(nullptr);
+            decorator->SetComponent(chain[depth]);
+            relink(depth, decorator);
+            ops.insert(ops.begin() + (chain.size() - depth), decorator->GetDrawOp());
+            chain.insert(chain.begin() + depth, decorator);
+            // Changed() из SetComponent пометил список, но он уже исправлен
+            stale = false;
+            return true;
+        }
 
-int main() {
+        // Вынимает декоратор с глубины depth; освобождать его должен вызывающий
+        Decorator* RemoveDecorator(size_t depth) {
+            if (stale) {
+                Compile();
+            }
+            if (depth + 1 >= chain.size()) {
+                return nullptr;
+            }
+            auto decorator = static_cast<Decorator*>(chain[depth]);
+            relink(depth, chain[depth + 1]);
+            decorator->SetParent(nullptr);
+            decorator->SetComponent(nullptr);
+            ops.erase(ops.begin() + (chain.size() - 1 - depth));
+            chain.erase(chain.begin() + depth);
+            stale = false;
+            return decorator;
+        }
+
+        ~FlattenedGlyph() {
+            if (root && !root->InArena()) {
+                delete root;
+            }
+        }
+};
+
+
+// Отрисовка глубокой цепочки: рекурсивный Draw против плоского списка
+void RunBenchmark(size_t depth, size_t frames) {
+    int fd = ::open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+    Glyph * chain = new MonoGlyph();
+    for (size_t i = 0; i < depth; i++) {
+        chain = i % 2 ? static_cast<Glyph*>(new Border(chain)) : new Scroller(chain);
+    }
+    FlattenedGlyph flattened(chain);
+    FdRenderSink sink(fd);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        chain->Draw(sink);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        flattened.Draw(sink);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink.Flush();
+    ::close(fd);
+
+    std::cout << depth << " decorators x " << frames << " frames: recursive "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, flattened "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+}
+
+// Построение и разрушение цепочки: куча с итеративным разбором против арены
+void RunChainBenchmark(size_t depth) {
+    auto begin = std::chrono::steady_clock::now();
+    Glyph * chain = new MonoGlyph();
+    for (size_t i = 0; i < depth; i++) {
+        chain = i % 2 ? static_cast<Glyph*>(new Border(chain)) : new Scroller(chain);
+    }
+    auto built = std::chrono::steady_clock::now();
+    delete chain;
+    auto destroyed = std::chrono::steady_clock::now();
+
+    GlyphArena arena;
+    auto arenaBegin = std::chrono::steady_clock::now();
+    Glyph * arenaChain = arena.Create<MonoGlyph>();
+    for (size_t i = 0; i < depth; i++) {
+        arenaChain = i % 2 ? static_cast<Glyph*>(arena.Create<Border>(arenaChain))
+                           : arena.Create<Scroller>(arenaChain);
+    }
+    auto arenaBuilt = std::chrono::steady_clock::now();
+    arena.Release();
+    auto arenaReleased = std::chrono::steady_clock::now();
+
+    auto ms = [](auto from, auto to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+    std::cout << depth << " decorators: heap build " << ms(begin, built) << " ms, destroy "
+              << ms(built, destroyed) << " ms; arena build " << ms(arenaBegin, arenaBuilt)
+              << " ms, release " << ms(arenaBuilt, arenaReleased) << " ms" << std::endl;
+}
+
+// Повторные кадры статичного оформления: полная отрисовка против кэша
+void RunCacheBenchmark(size_t depth, size_t frames) {
+    int fd = ::open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+    Glyph * chain = new MonoGlyph();
+    for (size_t i = 0; i < depth; i++) {
+        chain = i % 2 ? static_cast<Glyph*>(new Border(chain)) : new Scroller(chain);
+    }
+    Glyph * cachedChain = new MonoGlyph();
+    for (size_t i = 0; i < depth; i++) {
+        cachedChain = i % 2 ? static_cast<Glyph*>(new Border(cachedChain)) : new Scroller(cachedChain);
+    }
+    CachedGlyph cached(cachedChain);
+    FdRenderSink sink(fd);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        chain->Draw(sink);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        cached.Draw(sink);
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink.Flush();
+    ::close(fd);
+    delete chain;
+
+    std::cout << depth << " decorators x " << frames << " frames: uncached "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, cached "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        RunBenchmark(48, 100000);
+        RunBenchmark(10000, 500);
+        RunCacheBenchmark(48, 100000);
+        RunChainBenchmark(10000);
+        RunChainBenchmark(100000);
+        RunChainBenchmark(1000000);
+        return 0;
+    }
 
     Glyph * monoGlyph = new MonoGlyph();
 
@@ -61,9 +597,67 @@ int main() {
 
     Glyph * scrollerGlyph = new Scroller(borderGlyph);
 
-    scrollerGlyph->Draw();
+    FdRenderSink out;
 
+    scrollerGlyph->Draw(out);
     delete scrollerGlyph;
 
+    Label * title = new Label("title");
+    Border * frame = new Border(title);
+    FlattenedGlyph flattened(new Scroller(frame));
+
+    out << "Flattened:\n";
+    flattened.Draw(out);
+
+    out << "After inserting a border under the scroller:\n";
+    flattened.InsertDecorator(1, new Border(nullptr));
+    flattened.Draw(out);
+
+    out << "After removing the scroller:\n";
+    delete flattened.RemoveDecorator(0);
+    flattened.Draw(out);
+
+    // Changed() идёт от листа вверх по родителям: после удаления внешнего
+    // звена среди них не должно остаться удалённого скроллера
+    title->SetText("renamed");
+    out << "After the label changed:\n";
+    flattened.Draw(out);
+
+    // Лист заменён прямо в рамке, мимо FlattenedGlyph: список операций
+    // пересобирается, а не рисует удалённую метку
+    delete frame->ReleaseComponent();
+    frame->SetComponent(new Label("replaced"));
+    out << "After replacing the label in place:\n";
+    flattened.Draw(out);
+
+    Border * occupied = new Border(new MonoGlyph());
+    if (!flattened.InsertDecorator(0, occupied)) {
+        out << "A decorator with a component is not inserted\n";
+        delete occupied;
+    }
+
+    Label * label = new Label("draft");
+    CachedGlyph cached(new Scroller(new Border(label)));
+    out << "Cached, first frame:\n";
+    cached.Draw(out);
+    out << "Cached, replayed frame:\n";
+    cached.Draw(out);
+    label->SetText("final");
+    out << "Cached, after the label changed:\n";
+    cached.Draw(out);
+
+    GlyphArena arena;
+    Glyph * arenaGlyph = arena.Create<Scroller>(arena.Create<Border>(arena.Create<MonoGlyph>()));
+    out << "Allocated in an arena:\n";
+    arenaGlyph->Draw(out);
+
+    // Арена и куча вперемешку: рамка из кучи вокруг звена арены и звено
+    // арены вокруг метки из кучи. Каждый разрушает только своё.
+    Glyph * mixed = new Border(arena.Create<Scroller>(new Label("heap label")));
+    out << "Heap and arena glyphs mixed:\n";
+    mixed->Draw(out);
+    delete mixed;
+    arena.Release();
+
     return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,14 @@
 #include <iostream>
 #include <cstring>
+#include <cstdint>
+#include <array>
+#include <string_view>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <vector>
+#include <bit>
+#include <cstdlib>
 class Glyph {
 public:
     virtual ~Glyph() = default;
@@ -85,14 +94,214 @@ public:
 
 
 
+// Лёгкий хэндл виджета в пуле: номер слота и поколение, по которому
+// отлавливаются хэндлы уже освобождённых виджетов
+struct WidgetHandle {
+    uint32_t index;
+    uint32_t generation;
+};
+
+// Пул виджетов одного семейства: создаёт их пачками и переиспользует слоты
+template <typename Base>
+class WidgetPool {
+public:
+    virtual void Create(size_t count, std::vector<WidgetHandle>& handles) = 0;
+    virtual Base* Get(WidgetHandle handle) = 0;
+    virtual void Release(WidgetHandle handle) = 0;
+    virtual ~WidgetPool() = default;
+};
+
+// Виджеты конкретного типа лежат подряд в блоках слотов, блоки не
+// переезжают, а освобождённые слоты уходят в список свободных
+template <typename Base, typename T>
+class TypedWidgetPool : public WidgetPool<Base> {
+public:
+    void Create(size_t count, std::vector<WidgetHandle>& handles) override {
+        handles.reserve(handles.size() + count);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t index;
+            if (freeHead != kNoSlot) {
+                index = freeHead;
+                freeHead = slot(index).nextFree;
+            } else {
+                if (size % kBlockSize == 0) {
+                    blocks.push_back(std::make_unique<Slot[]>(kBlockSize));
+                }
+                index = size++;
+            }
+            Slot& s = slot(index);
+            new (s.storage) T();
+            s.live = true;
+            handles.push_back({index, s.generation});
+        }
+    }
+
+    Base* Get(WidgetHandle handle) override {
+        if (handle.index >= size) {
+            return nullptr;
+        }
+        Slot& s = slot(handle.index);
+        return s.live && s.generation == handle.generation ? object(s) : nullptr;
+    }
+
+    void Release(WidgetHandle handle) override {
+        if (!Get(handle)) {
+            return;
+        }
+        Slot& s = slot(handle.index);
+        object(s)->~T();
+        s.live = false;
+        s.generation++;
+        s.nextFree = freeHead;
+        freeHead = handle.index;
+    }
+
+    ~TypedWidgetPool() {
+        for (uint32_t index = 0; index < size; index++) {
+            Slot& s = slot(index);
+            if (s.live) {
+                object(s)->~T();
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kBlockSize = 1024;
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t generation = 0;
+        uint32_t nextFree = kNoSlot;
+        bool live = false;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> blocks;
+    uint32_t size = 0;
+    uint32_t freeHead = kNoSlot;
+
+    Slot& slot(uint32_t index) {
+        return blocks[index / kBlockSize][index % kBlockSize];
+    }
+
+    static T* object(Slot& s) {
+        return std::launder(reinterpret_cast<T*>(s.storage));
+    }
+};
+
 class GUIFactory {
 public:
     virtual ScrollBar* CreateScrollBar() = 0;
     virtual Button* CreateButton() = 0;
     virtual Menu* CreateMenu() = 0;
+
+    // Пулы для массового создания виджетов этого стиля
+    virtual std::unique_ptr<WidgetPool<ScrollBar>> CreateScrollBarPool() = 0;
+    virtual std::unique_ptr<WidgetPool<Button>> CreateButtonPool() = 0;
+    virtual std::unique_ptr<WidgetPool<Menu>> CreateMenuPool() = 0;
+
     virtual ~GUIFactory() = default;
 };
 
+// Стили, известные на этапе компиляции. По ним constexpr-перебором
+// подбирается затравка хеша, при которой все имена попадают в разные
+// ячейки таблицы - поиск стоит одного хеша и одного сравнения строк.
+// Размер таблицы выводится из списка: ближайшая сверху степень двойки.
+constexpr std::string_view kStyleNames[] = {"Motif", "Presentation_Manager", "Mac"};
+constexpr size_t kStyleTableSize = std::bit_ceil(std::size(kStyleNames));
+
+// Хешируются только длина и три символа: затравка подбирается так, чтобы
+// этого хватало для различения известных имён, а неизвестные отсеивает
+// сравнение с именем в ячейке
+constexpr uint32_t StyleHash(std::string_view name, uint32_t seed) {
+    if (name.empty()) {
+        return seed;
+    }
+    uint32_t key = static_cast<uint32_t>(name.size())
+        | static_cast<uint32_t>(static_cast<unsigned char>(name.front())) << 8
+        | static_cast<uint32_t>(static_cast<unsigned char>(name[name.size() / 2])) << 16
+        | static_cast<uint32_t>(static_cast<unsigned char>(name.back())) << 24;
+    uint32_t hash = (key ^ seed) * 0x9E3779B1u;
+    return hash ^ (hash >> 16);
+}
+
+constexpr size_t StyleSlot(std::string_view name, uint32_t seed) {
+    return StyleHash(name, seed) & (kStyleTableSize - 1);
+}
+
+constexpr uint32_t FindStyleSeed() {
+    for (uint32_t seed = 1; seed < 100000; seed++) {
+        bool used[kStyleTableSize] = {};
+        bool perfect = true;
+        for (std::string_view name : kStyleNames) {
+            size_t slot = StyleSlot(name, seed);
+            if (used[slot]) {
+                perfect = false;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (perfect) {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+constexpr uint32_t kStyleSeed = FindStyleSeed();
+static_assert(kStyleSeed != 0, "no perfect hash seed for style names");
+
+constexpr std::array<std::string_view, kStyleTableSize> BuildStyleSlots() {
+    std::array<std::string_view, kStyleTableSize> slots{};
+    for (std::string_view name : kStyleNames) {
+        slots[StyleSlot(name, kStyleSeed)] = name;
+    }
+    return slots;
+}
+
+constexpr std::array<std::string_view, kStyleTableSize> kStyleSlots = BuildStyleSlots();
+
+// Реестр общих фабрик без состояния: каждая фабрика регистрирует свой
+// единственный экземпляр, а поиск возвращает его без выделения памяти.
+// Регистрация отклоняется для стиля не из kStyleNames и для стиля, уже
+// занятого другой фабрикой.
+class FactoryRegistry {
+public:
+    static bool Register(std::string_view styleName, GUIFactory* factory) {
+        size_t slot = StyleSlot(styleName, kStyleSeed);
+        if (kStyleSlots[slot] != styleName || (factories[slot] && factories[slot] != factory)) {
+            return false;
+        }
+        factories[slot] = factory;
+        return true;
+    }
+
+    static GUIFactory* Find(std::string_view styleName) {
+        size_t slot = StyleSlot(styleName, kStyleSeed);
+        return kStyleSlots[slot] == styleName ? factories[slot] : nullptr;
+    }
+
+private:
+    // Инициализируется нулями ещё до статических регистраций
+    static inline std::array<GUIFactory*, kStyleTableSize> factories{};
+};
+
+// Регистрация при статической инициализации: ошибку некому вернуть, а
+// молча пропавшая фабрика всплыла бы только при первом поиске, поэтому
+// программа останавливается сразу
+template <typename FactoryT>
+class FactoryRegistration {
+public:
+    explicit FactoryRegistration(std::string_view styleName) {
+        static FactoryT instance;
+        if (!FactoryRegistry::Register(styleName, &instance)) {
+            std::cerr << "FactoryRegistration: cannot register style \"" << styleName
+                      << "\"; add it to kStyleNames" << std::endl;
+            std::abort();
+        }
+    }
+};
+
 class MotifFactory : public GUIFactory {
 public:
     ScrollBar* CreateScrollBar() override {
@@ -106,8 +315,22 @@ public:
     Menu* CreateMenu() override {
         return new MotifMenu();
     }
+
+    std::unique_ptr<WidgetPool<ScrollBar>> CreateScrollBarPool() override {
+        return std::make_unique<TypedWidgetPool<ScrollBar, MotifScrollBar>>();
+    }
+
+    std::unique_ptr<WidgetPool<Button>> CreateButtonPool() override {
+        return std::make_unique<TypedWidgetPool<Button, MotifButton>>();
+    }
+
+    std::unique_ptr<WidgetPool<Menu>> CreateMenuPool() override {
+        return std::make_unique<TypedWidgetPool<Menu, MotifMenu>>();
+    }
 };
 
+static FactoryRegistration<MotifFactory> motifFactoryRegistration("Motif");
+
 class PMFactory : public GUIFactory {
 public:
     ScrollBar* CreateScrollBar() override {
@@ -121,8 +344,22 @@ public:
     Menu* CreateMenu() override {
         return new PMMenu();
     }
+
+    std::unique_ptr<WidgetPool<ScrollBar>> CreateScrollBarPool() override {
+        return std::make_unique<TypedWidgetPool<ScrollBar, PMScrollBar>>();
+    }
+
+    std::unique_ptr<WidgetPool<Button>> CreateButtonPool() override {
+        return std::make_unique<TypedWidgetPool<Button, PMButton>>();
+    }
+
+    std::unique_ptr<WidgetPool<Menu>> CreateMenuPool() override {
+        return std::make_unique<TypedWidgetPool<Menu, PMMenu>>();
+    }
 };
 
+static FactoryRegistration<PMFactory> pmFactoryRegistration("Presentation_Manager");
+
 class MacFactory : public GUIFactory {
 public:
     ScrollBar* CreateScrollBar() override {
@@ -136,9 +373,29 @@ public:
     Menu* CreateMenu() override {
         return new MacMenu();
     }
+
+    std::unique_ptr<WidgetPool<ScrollBar>> CreateScrollBarPool() override {
+        return std::make_unique<TypedWidgetPool<ScrollBar, MacScrollBar>>();
+    }
+
+    std::unique_ptr<WidgetPool<Button>> CreateButtonPool() override {
+        return std::make_unique<TypedWidgetPool<Button, MacButton>>();
+    }
+
+    std::unique_ptr<WidgetPool<Menu>> CreateMenuPool() override {
+        return std::make_unique<TypedWidgetPool<Menu, MacMenu>>();
+    }
 };
 
-GUIFactory* CreateFactory(const char* styleName) {
+static FactoryRegistration<MacFactory> macFactoryRegistration("Mac");
+
+// Фабрика возвращается общая: вызывающий её не удаляет
+GUIFactory* GetFactory(const char* styleName) {
+    return FactoryRegistry::Find(styleName);
+}
+
+// Прежний поиск: цепочка strcmp и новая фабрика на каждый вызов
+GUIFactory* CreateFactoryWithStrcmp(const char* styleName) {
     if (strcmp(styleName, "Motif") == 0) {
         return new MotifFactory();
     } else if (strcmp(styleName, "Presentation_Manager") == 0) {
@@ -150,9 +407,68 @@ GUIFactory* CreateFactory(const char* styleName) {
     }
 }
 
-int main() {
+void RunBenchmark(size_t lookups) {
+    const char* styles[] = {"Motif", "Presentation_Manager", "Mac", "Unknown"};
+    size_t found = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        GUIFactory* factory = CreateFactoryWithStrcmp(styles[i % 4]);
+        found += factory != nullptr;
+        delete factory;
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        found += GetFactory(styles[i % 4]) != nullptr;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << lookups << " lookups: strcmp + new "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, registry "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms ("
+              << found << " found)" << std::endl;
+}
+
+// Большой диалог: по виджету через new/delete против пачки из пула
+void RunPoolBenchmark(size_t count) {
+    GUIFactory* factory = GetFactory("Mac");
+    std::vector<Button*> buttons;
+    buttons.reserve(count);
+    auto begin = std::chrono::steady_clock::now();
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = 0; i < count; i++) {
+            buttons.push_back(factory->CreateButton());
+        }
+        for (Button* button : buttons) {
+            delete button;
+        }
+        buttons.clear();
+    }
+    auto middle = std::chrono::steady_clock::now();
+    auto pool = factory->CreateButtonPool();
+    std::vector<WidgetHandle> handles;
+    for (int round = 0; round < 10; round++) {
+        pool->Create(count, handles);
+        for (WidgetHandle handle : handles) {
+            pool->Release(handle);
+        }
+        handles.clear();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "10 x " << count << " buttons: new/delete "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, pool "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        RunBenchmark(10000000);
+        RunPoolBenchmark(100000);
+        return 0;
+    }
+
     const char* styleName = "Motif";
-    GUIFactory* factory = CreateFactory(styleName);
+    GUIFactory* factory = GetFactory(styleName);
 
     if (factory) {
         ScrollBar* scrollBar = factory->CreateScrollBar();
@@ -166,7 +482,17 @@ int main() {
         delete scrollBar;
         delete button;
         delete menu;
-        delete factory;
+
+        auto buttonPool = factory->CreateButtonPool();
+        std::vector<WidgetHandle> buttons;
+        buttonPool->Create(3, buttons);
+        for (WidgetHandle handle : buttons) {
+            buttonPool->Get(handle)->Press();
+        }
+        buttonPool->Release(buttons[1]);
+        if (!buttonPool->Get(buttons[1])) {
+            std::cout << "Released button handle is no longer valid" << std::endl;
+        }
     } else {
         std::cout << "Unknown style" << std::endl;
     }
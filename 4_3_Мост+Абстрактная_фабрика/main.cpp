@@ -1,5 +1,12 @@
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
 
 class Glyph {
 public:
@@ -11,7 +18,72 @@ class WindowImp {
 public:
     virtual void DeviceRaise() = 0;
     virtual void DeviceRect(int x0, int y0, int x1, int y1) = 0;
+
+    // Приводит контекст устройства в исходное состояние при повторной выдаче
+    virtual void Reset() {}
+
     virtual ~WindowImp() = default;
+
+private:
+    friend class WindowImpRef;
+    template <typename Imp>
+    friend class PooledWindowSystemFactory;
+
+    std::atomic<int> refs{0};
+    // Куда вернуть контекст после последней ссылки; nullptr - удалить
+    void (*recycle)(WindowImp*) = nullptr;
+    // Кэш потока, которому принадлежит контекст
+    const void* home = nullptr;
+};
+
+// Счётная ссылка на контекст устройства: несколько окон могут делить
+// один контекст, а последняя ссылка возвращает его в пул фабрики
+class WindowImpRef {
+private:
+    WindowImp* imp = nullptr;
+
+    void release() {
+        if (imp && imp->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (imp->recycle) {
+                imp->recycle(imp);
+            } else {
+                delete imp;
+            }
+        }
+        imp = nullptr;
+    }
+
+public:
+    WindowImpRef() = default;
+
+    explicit WindowImpRef(WindowImp* imp) : imp(imp) {
+        if (imp) {
+            imp->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    WindowImpRef(const WindowImpRef& other) : WindowImpRef(other.imp) {}
+
+    WindowImpRef(WindowImpRef&& other) noexcept : imp(other.imp) {
+        other.imp = nullptr;
+    }
+
+    WindowImpRef& operator=(WindowImpRef other) noexcept {
+        std::swap(imp, other.imp);
+        return *this;
+    }
+
+    ~WindowImpRef() {
+        release();
+    }
+
+    WindowImp* operator->() const {
+        return imp;
+    }
+
+    WindowImp* get() const {
+        return imp;
+    }
 };
 
 class XWindowImp : public WindowImp {
@@ -53,38 +125,99 @@ public:
 class WindowSystemFactory {
 public:
     virtual WindowImp* CreateWindowImp() = 0;
+
+    // Контекст для нового окна; без пула он создаётся заново
+    virtual WindowImpRef AcquireWindowImp() {
+        return WindowImpRef(CreateWindowImp());
+    }
+
     virtual ~WindowSystemFactory() = default;
 };
 
-class PWMindowSystemFactory : public WindowSystemFactory {
-public:
-    WindowImp* CreateWindowImp() override {
-        return new PMWindowImp();
+// Фабрика с пулом контекстов одного типа устройства. Освобождённый контекст
+// попадает в кэш потока, где он был выдан, и достаётся следующему окну
+// этого потока без блокировок и выделения памяти. Контекст, отпущенный
+// чужим потоком, уходит в общий пул под мьютексом.
+template <typename Imp>
+class PooledWindowSystemFactory : public WindowSystemFactory {
+private:
+    struct Cache {
+        std::vector<WindowImp*> items;
+
+        ~Cache() {
+            for (WindowImp* imp : items) {
+                delete imp;
+            }
+        }
+    };
+
+    static Cache& local() {
+        static thread_local Cache cache;
+        return cache;
     }
-};
 
-class XWindowSystemFactory : public WindowSystemFactory {
-public:
-    WindowImp* CreateWindowImp() override {
-        return new XWindowImp();
+    static inline std::mutex sharedMutex;
+    static inline Cache shared;
+    static inline std::atomic<size_t> created{0};
+
+    static void Recycle(WindowImp* imp) {
+        if (imp->home == &local()) {
+            local().items.push_back(imp);
+        } else {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            shared.items.push_back(imp);
+        }
     }
-};
 
-class MacWindowSystemFactory : public WindowSystemFactory {
 public:
     WindowImp* CreateWindowImp() override {
-        return new MacWindowImp();
+        created.fetch_add(1, std::memory_order_relaxed);
+        return new Imp();
+    }
+
+    WindowImpRef AcquireWindowImp() override {
+        WindowImp* imp = nullptr;
+        Cache& cache = local();
+        if (!cache.items.empty()) {
+            imp = cache.items.back();
+            cache.items.pop_back();
+        } else {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            if (!shared.items.empty()) {
+                imp = shared.items.back();
+                shared.items.pop_back();
+            }
+        }
+        if (imp) {
+            imp->Reset();
+        } else {
+            imp = CreateWindowImp();
+            imp->recycle = &Recycle;
+        }
+        imp->home = &cache;
+        return WindowImpRef(imp);
+    }
+
+    static size_t Created() {
+        return created.load(std::memory_order_relaxed);
     }
 };
 
+class PWMindowSystemFactory : public PooledWindowSystemFactory<PMWindowImp> {
+};
+
+class XWindowSystemFactory : public PooledWindowSystemFactory<XWindowImp> {
+};
+
+class MacWindowSystemFactory : public PooledWindowSystemFactory<MacWindowImp> {
+};
+
 class Window {
 protected:
-    std::unique_ptr<WindowImp> imp;
+    WindowImpRef imp;
 
 public:
-    Window(WindowSystemFactory* factory) {
-        imp.reset(factory->CreateWindowImp());
-    }
+    Window(WindowSystemFactory* factory) : imp(factory->AcquireWindowImp()) {}
 
     virtual void Raise() {
         imp->DeviceRaise();
@@ -137,7 +270,51 @@ public:
     }
 };
 
-int main() {
+// Частое открытие и закрытие окон: новый контекст на окно против пула
+void RunBenchmark(size_t windows) {
+    XWindowSystemFactory factory;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < windows; i++) {
+        std::unique_ptr<WindowImp> imp(factory.CreateWindowImp());
+    }
+    auto middle = std::chrono::steady_clock::now();
+    size_t before = XWindowSystemFactory::Created();
+    for (size_t i = 0; i < windows; i++) {
+        ApplicationWindow window(&factory);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << windows << " windows: new context each "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, pooled "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms ("
+              << XWindowSystemFactory::Created() - before << " contexts created)" << std::endl;
+
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    before = XWindowSystemFactory::Created();
+    begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&factory, windows, threads] {
+            for (size_t i = 0; i < windows / threads; i++) {
+                ApplicationWindow window(&factory);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "  on " << threads << " threads: "
+              << std::chrono::duration<double, std::milli>(end - begin).count() << " ms ("
+              << XWindowSystemFactory::Created() - before << " contexts created)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        RunBenchmark(1000000);
+        return 0;
+    }
+
     PWMindowSystemFactory pmFactory;
     XWindowSystemFactory xFactory;
     MacWindowSystemFactory macFactory;
@@ -1,5 +1,21 @@
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <random>
+#include <unordered_map>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 class Glyph {
 public:
@@ -7,13 +23,620 @@ public:
     virtual ~Glyph() = default;
 };
 
+// Записанная операция устройства. Прямоугольник полуоткрытый: [x0, x1) x [y0, y1)
+struct DeviceCommand {
+    enum Kind : uint8_t { kRaise, kRect, kColor };
+    Kind kind;
+    int x0, y0, x1, y1;
+    uint32_t color;
+};
+
 class WindowImp {
 public:
     virtual void DeviceRaise() = 0;
     virtual void DeviceRect(int x0, int y0, int x1, int y1) = 0;
+
+    // Цвет заливки следующих прямоугольников (байты R, G, B, A в памяти);
+    // текстовые устройства его не используют
+    virtual void DeviceColor(uint32_t) {}
+
+    // Пакет команд за кадр; устройство может переопределить его,
+    // чтобы не платить за каждый вызов отдельно
+    virtual void DeviceSubmit(const DeviceCommand* commands, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const DeviceCommand& c = commands[i];
+            if (c.kind == DeviceCommand::kRaise) {
+                DeviceRaise();
+            } else if (c.kind == DeviceCommand::kColor) {
+                DeviceColor(c.color);
+            } else {
+                DeviceRect(c.x0, c.y0, c.x1, c.y1);
+            }
+        }
+    }
+
     virtual ~WindowImp() = default;
 };
 
+// Заливка отрезка строки пикселей одним значением
+using SpanFill = void (*)(uint32_t* dst, size_t count, uint32_t value);
+
+void FillSpanScalar(uint32_t* dst, size_t count, uint32_t value) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = value;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void FillSpanSSE2(uint32_t* dst, size_t count, uint32_t value) {
+    __m128i v = _mm_set1_epi32(static_cast<int>(value));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    for (; i < count; i++) {
+        dst[i] = value;
+    }
+}
+
+__attribute__((target("avx2")))
+void FillSpanAVX2(uint32_t* dst, size_t count, uint32_t value) {
+    __m256i v = _mm256_set1_epi32(static_cast<int>(value));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), v);
+    }
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    for (; i < count; i++) {
+        dst[i] = value;
+    }
+}
+#endif
+
+// Лучшая заливка, которую поддерживает процессор, выбирается при запуске
+SpanFill SelectSpanFill() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return FillSpanAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return FillSpanSSE2;
+    }
+#endif
+    return FillSpanScalar;
+}
+
+// Пул потоков для параллельных циклов: потоки разбирают индексы
+// через общий атомарный счётчик, вызывающий поток работает вместе с ними
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)>* job = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+    size_t busy = 0;
+    // Сколько рабочих уже взяли текущее поколение задания: ParallelFor ждёт
+    // всех, иначе опоздавший рабочий прочёл бы job, который к тому времени
+    // уже уничтожен, или индексы следующего задания
+    size_t acknowledged = 0;
+    size_t generation = 0;
+    bool stopping = false;
+
+    void run(const std::function<void(size_t)>& body, size_t total) {
+        for (size_t i = next.fetch_add(1); i < total; i = next.fetch_add(1)) {
+            body(i);
+        }
+    }
+
+    void workerLoop() {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            const std::function<void(size_t)>* body = job;
+            size_t total = count;
+            acknowledged++;
+            busy++;
+            lock.unlock();
+            run(*body, total);
+            lock.lock();
+            if (--busy == 0 && acknowledged == workers.size()) {
+                done.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 1; i < std::max<size_t>(threads, 1); i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    size_t size() const {
+        return workers.size() + 1;
+    }
+
+    // Вызывает body(i) для всех i из [0, total) и дожидается завершения
+    void ParallelFor(size_t total, const std::function<void(size_t)>& body) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &body;
+            count = total;
+            next.store(0);
+            acknowledged = 0;
+            generation++;
+        }
+        wake.notify_all();
+        run(body, total);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return busy == 0 && acknowledged == workers.size(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+};
+
+// Программное устройство: рисует в собственный RGBA-буфер кадра, так что
+// мост работает без оконной системы, а результат можно сохранить в PPM
+class RasterWindowImp : public WindowImp {
+private:
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;
+    uint32_t color = 0xFF000000;
+    SpanFill fill = SelectSpanFill();
+    size_t raises = 0;
+
+    // Прямоугольник кадра с уже известным цветом
+    struct BinnedRect {
+        int x0, y0, x1, y1;
+        uint32_t color;
+    };
+
+    ThreadPool* pool = nullptr;
+    int tileSize = 128;
+    std::vector<BinnedRect> rects;
+    // bins[t] - номера прямоугольников, задевающих плитку t, в порядке рисования
+    std::vector<std::vector<uint32_t>> bins;
+
+    void fillRect(int x0, int y0, int x1, int y1, uint32_t value) {
+        for (int y = y0; y < y1; y++) {
+            fill(&pixels[static_cast<size_t>(y) * width + x0], x1 - x0, value);
+        }
+    }
+
+    // Раскладывает прямоугольники пакета по плиткам и растеризует плитки
+    // параллельно. Плитки не пересекаются, а внутри плитки порядок
+    // прямоугольников сохранён, поэтому кадр совпадает с последовательным.
+    void submitTiled(const DeviceCommand* commands, size_t count) {
+        int tilesX = (width + tileSize - 1) / tileSize;
+        int tilesY = (height + tileSize - 1) / tileSize;
+        bins.resize(static_cast<size_t>(tilesX) * tilesY);
+        for (auto& bin : bins) {
+            bin.clear();
+        }
+        rects.clear();
+        for (size_t i = 0; i < count; i++) {
+            const DeviceCommand& c = commands[i];
+            if (c.kind == DeviceCommand::kRaise) {
+                DeviceRaise();
+            } else if (c.kind == DeviceCommand::kColor) {
+                color = c.color;
+            } else {
+                BinnedRect r{std::max(c.x0, 0), std::max(c.y0, 0),
+                             std::min(c.x1, width), std::min(c.y1, height), color};
+                if (r.x0 >= r.x1 || r.y0 >= r.y1) {
+                    continue;
+                }
+                uint32_t index = static_cast<uint32_t>(rects.size());
+                rects.push_back(r);
+                for (int ty = r.y0 / tileSize; ty <= (r.y1 - 1) / tileSize; ty++) {
+                    for (int tx = r.x0 / tileSize; tx <= (r.x1 - 1) / tileSize; tx++) {
+                        bins[static_cast<size_t>(ty) * tilesX + tx].push_back(index);
+                    }
+                }
+            }
+        }
+        std::function<void(size_t)> rasterizeTile = [&](size_t t) {
+            int tx0 = static_cast<int>(t % tilesX) * tileSize;
+            int ty0 = static_cast<int>(t / tilesX) * tileSize;
+            int tx1 = std::min(tx0 + tileSize, width);
+            int ty1 = std::min(ty0 + tileSize, height);
+            for (uint32_t index : bins[t]) {
+                const BinnedRect& r = rects[index];
+                fillRect(std::max(r.x0, tx0), std::max(r.y0, ty0),
+                         std::min(r.x1, tx1), std::min(r.y1, ty1), r.color);
+            }
+        };
+        pool->ParallelFor(bins.size(), rasterizeTile);
+    }
+
+public:
+    RasterWindowImp(int width, int height, uint32_t background = 0xFFFFFFFF)
+        : width(width), height(height), pixels(static_cast<size_t>(width) * height, background) {}
+
+    void DeviceRaise() override {
+        raises++;
+    }
+
+    void DeviceColor(uint32_t rgba) override {
+        color = rgba;
+    }
+
+    void DeviceRect(int x0, int y0, int x1, int y1) override {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, width);
+        y1 = std::min(y1, height);
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+        fillRect(x0, y0, x1, y1, color);
+    }
+
+    void DeviceSubmit(const DeviceCommand* commands, size_t count) override {
+        if (pool) {
+            submitTiled(commands, count);
+        } else {
+            WindowImp::DeviceSubmit(commands, count);
+        }
+    }
+
+    // С пулом пакеты кадра растеризуются по плиткам tileSize x tileSize
+    void SetThreadPool(ThreadPool* p, int tile = 128) {
+        pool = p;
+        tileSize = std::max(tile, 8);
+    }
+
+    const std::vector<uint32_t>& Pixels() const {
+        return pixels;
+    }
+
+    void SetSpanFill(SpanFill f) {
+        fill = f;
+    }
+
+    uint32_t Pixel(int x, int y) const {
+        return pixels[static_cast<size_t>(y) * width + x];
+    }
+
+    size_t Raises() const {
+        return raises;
+    }
+
+    // Сохраняет кадр в двоичный PPM (P6), альфа-канал отбрасывается
+    bool WritePPM(const char* path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        file << "P6\n" << width << " " << height << "\n255\n";
+        std::vector<char> row(static_cast<size_t>(width) * 3);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint32_t p = Pixel(x, y);
+                row[x * 3] = static_cast<char>(p & 0xFF);
+                row[x * 3 + 1] = static_cast<char>((p >> 8) & 0xFF);
+                row[x * 3 + 2] = static_cast<char>((p >> 16) & 0xFF);
+            }
+            file.write(row.data(), row.size());
+        }
+        return static_cast<bool>(file);
+    }
+};
+
+struct Bounds {
+    int x0, y0, x1, y1;
+};
+
+// Банд-регион: горизонтальные полосы, в каждой - отсортированные
+// непересекающиеся отрезки [x0, x1). Соседние полосы с одинаковыми
+// отрезками сливаются, так что регион раскладывается в минимальный для
+// такого представления набор непересекающихся прямоугольников.
+class Region {
+private:
+    struct Band {
+        int y0, y1;
+        std::vector<int> spans;
+    };
+
+    std::vector<Band> bands;
+
+    // Отрезки полосы, объединённые с [x0, x1)
+    static std::vector<int> unionSpans(const std::vector<int>& spans, int x0, int x1) {
+        std::vector<int> out;
+        out.reserve(spans.size() + 2);
+        size_t i = 0;
+        for (; i < spans.size() && spans[i + 1] < x0; i += 2) {
+            out.push_back(spans[i]);
+            out.push_back(spans[i + 1]);
+        }
+        for (; i < spans.size() && spans[i] <= x1; i += 2) {
+            x0 = std::min(x0, spans[i]);
+            x1 = std::max(x1, spans[i + 1]);
+        }
+        out.push_back(x0);
+        out.push_back(x1);
+        out.insert(out.end(), spans.begin() + i, spans.end());
+        return out;
+    }
+
+    // [x0, x1) без отрезков полосы
+    static std::vector<int> subtractFromRange(int x0, int x1, const std::vector<int>& spans) {
+        std::vector<int> out;
+        for (size_t i = 0; i < spans.size() && x0 < x1; i += 2) {
+            if (spans[i + 1] <= x0) {
+                continue;
+            }
+            if (spans[i] >= x1) {
+                break;
+            }
+            if (spans[i] > x0) {
+                out.push_back(x0);
+                out.push_back(spans[i]);
+            }
+            x0 = std::max(x0, spans[i + 1]);
+        }
+        if (x0 < x1) {
+            out.push_back(x0);
+            out.push_back(x1);
+        }
+        return out;
+    }
+
+    static void append(std::vector<Band>& out, int y0, int y1, std::vector<int> spans) {
+        if (y0 >= y1 || spans.empty()) {
+            return;
+        }
+        if (!out.empty() && out.back().y1 == y0 && out.back().spans == spans) {
+            out.back().y1 = y1;
+            return;
+        }
+        out.push_back({y0, y1, std::move(spans)});
+    }
+
+    // Первая полоса, заканчивающаяся ниже y
+    size_t firstBandBelow(int y) const {
+        return std::upper_bound(bands.begin(), bands.end(), y,
+                                [](int value, const Band& band) { return value < band.y1; })
+               - bands.begin();
+    }
+
+public:
+    bool Empty() const {
+        return bands.empty();
+    }
+
+    void Union(const Bounds& r) {
+        if (r.x0 >= r.x1 || r.y0 >= r.y1) {
+            return;
+        }
+        // Затронуты только полосы, пересекающие [y0, y1), и их соседи для слияния
+        size_t first = firstBandBelow(r.y0);
+        size_t last = first;
+        std::vector<Band> replaced;
+        if (first > 0) {
+            replaced.push_back(std::move(bands[first - 1]));
+        }
+        int y = r.y0;
+        for (; last < bands.size() && bands[last].y0 < r.y1; last++) {
+            Band& band = bands[last];
+            if (band.y0 < y) {
+                append(replaced, band.y0, y, band.spans);
+            }
+            append(replaced, y, band.y0, {r.x0, r.x1});
+            int top = std::max(band.y0, y);
+            int bottom = std::min(band.y1, r.y1);
+            append(replaced, top, bottom, unionSpans(band.spans, r.x0, r.x1));
+            append(replaced, bottom, band.y1, band.spans);
+            y = bottom;
+        }
+        append(replaced, y, r.y1, {r.x0, r.x1});
+        if (last < bands.size()) {
+            append(replaced, bands[last].y0, bands[last].y1, std::move(bands[last].spans));
+            last++;
+        }
+        size_t begin = first > 0 ? first - 1 : first;
+        bands.erase(bands.begin() + begin, bands.begin() + last);
+        bands.insert(bands.begin() + begin, std::make_move_iterator(replaced.begin()),
+                     std::make_move_iterator(replaced.end()));
+    }
+
+    void Union(const Region& other) {
+        for (const Band& band : other.bands) {
+            for (size_t i = 0; i < band.spans.size(); i += 2) {
+                Union({band.spans[i], band.y0, band.spans[i + 1], band.y1});
+            }
+        }
+    }
+
+    // Часть прямоугольника, не покрытая регионом
+    Region Uncovered(const Bounds& r) const {
+        Region out;
+        if (r.x0 >= r.x1 || r.y0 >= r.y1) {
+            return out;
+        }
+        int y = r.y0;
+        for (size_t b = firstBandBelow(r.y0); b < bands.size() && bands[b].y0 < r.y1; b++) {
+            const Band& band = bands[b];
+            append(out.bands, y, band.y0, {r.x0, r.x1});
+            int top = std::max(band.y0, y);
+            int bottom = std::min(band.y1, r.y1);
+            append(out.bands, top, bottom, subtractFromRange(r.x0, r.x1, band.spans));
+            y = bottom;
+        }
+        append(out.bands, y, r.y1, {r.x0, r.x1});
+        return out;
+    }
+
+    template <typename Visitor>
+    void ForEachRect(Visitor visit) const {
+        for (const Band& band : bands) {
+            for (size_t i = 0; i < band.spans.size(); i += 2) {
+                visit(Bounds{band.spans[i], band.y0, band.spans[i + 1], band.y1});
+            }
+        }
+    }
+};
+
+// Буфер команд кадра: операции копятся в непрерывном массиве и уходят
+// в устройство одним пакетом. Перед отправкой подряд идущие подъёмы окна
+// сводятся к одному, повтор только что записанного прямоугольника
+// отбрасывается, а два соседних прямоугольника склеиваются, если вместе
+// дают ровно прямоугольник: с общим ребром ([x0, x1) и [x1, x2) при тех же
+// [y0, y1), или то же по вертикали). Прямоугольники полуоткрытые, поэтому
+// склейка не добавляет и не теряет пикселей. Подъём - граница склейки:
+// он остаётся между теми же рисованиями, что и в записи, так что порядок
+// подъёмов относительно рисования сохраняется.
+class CommandBuffer {
+private:
+    std::vector<DeviceCommand> commands;
+    std::vector<DeviceCommand> batch;
+
+    void addRect(const DeviceCommand& rect) {
+        if (!batch.empty() && batch.back().kind == DeviceCommand::kRect) {
+            DeviceCommand& last = batch.back();
+            if (last.x0 == rect.x0 && last.y0 == rect.y0 && last.x1 == rect.x1 && last.y1 == rect.y1) {
+                return;
+            }
+            if (last.y0 == rect.y0 && last.y1 == rect.y1 && last.x1 == rect.x0) {
+                last.x1 = rect.x1;
+                return;
+            }
+            if (last.x0 == rect.x0 && last.x1 == rect.x1 && last.y1 == rect.y0) {
+                last.y1 = rect.y1;
+                return;
+            }
+        }
+        batch.push_back(rect);
+    }
+
+public:
+    void Raise() {
+        commands.push_back({DeviceCommand::kRaise, 0, 0, 0, 0, 0});
+    }
+
+    void Rect(int x0, int y0, int x1, int y1) {
+        commands.push_back({DeviceCommand::kRect, x0, y0, x1, y1, 0});
+    }
+
+    void Color(uint32_t rgba) {
+        commands.push_back({DeviceCommand::kColor, 0, 0, 0, 0, rgba});
+    }
+
+    size_t size() const {
+        return commands.size();
+    }
+
+    void Submit(WindowImp& imp) {
+        batch.clear();
+        for (const DeviceCommand& command : commands) {
+            if (command.kind == DeviceCommand::kRaise) {
+                if (batch.empty() || batch.back().kind != DeviceCommand::kRaise) {
+                    batch.push_back(command);
+                }
+            } else if (command.kind == DeviceCommand::kColor) {
+                batch.push_back(command);
+            } else {
+                addRect(command);
+            }
+        }
+        commands.clear();
+        if (!batch.empty()) {
+            imp.DeviceSubmit(batch.data(), batch.size());
+        }
+    }
+
+    // Отправка через трекер повреждений: прямоугольники разбираются от
+    // последнего к первому, и каждый оставляет только ещё не закрытую
+    // более поздними часть. Видимые части одного цвета сливаются в регион,
+    // так что устройство получает непересекающиеся прямоугольники и
+    // каждый пиксель кадра закрашивается ровно один раз. Порядок рисования
+    // здесь не сохраняется (отправляется только итог кадра), поэтому
+    // подъёмы кадра сводятся к одному после всех прямоугольников.
+    void SubmitDamage(WindowImp& imp) {
+        struct ColoredRect {
+            Bounds rect;
+            size_t group;
+        };
+        // Группа 0 - прямоугольники до первой смены цвета в кадре
+        std::vector<uint32_t> groupColors{0};
+        std::unordered_map<uint32_t, size_t> groupOf;
+        std::vector<ColoredRect> rects;
+        size_t group = 0;
+        bool raise = false;
+        for (const DeviceCommand& command : commands) {
+            if (command.kind == DeviceCommand::kRaise) {
+                raise = true;
+            } else if (command.kind == DeviceCommand::kColor) {
+                auto found = groupOf.emplace(command.color, groupColors.size());
+                if (found.second) {
+                    groupColors.push_back(command.color);
+                }
+                group = found.first->second;
+            } else {
+                rects.push_back({{command.x0, command.y0, command.x1, command.y1}, group});
+            }
+        }
+        commands.clear();
+
+        std::vector<Region> visible(groupColors.size());
+        Region covered;
+        for (size_t i = rects.size(); i > 0; i--) {
+            const ColoredRect& r = rects[i - 1];
+            Region uncovered = covered.Uncovered(r.rect);
+            if (!uncovered.Empty()) {
+                visible[r.group].Union(uncovered);
+                covered.Union(r.rect);
+            }
+        }
+
+        batch.clear();
+        for (size_t g = 0; g < visible.size(); g++) {
+            if (visible[g].Empty()) {
+                continue;
+            }
+            if (g > 0) {
+                batch.push_back({DeviceCommand::kColor, 0, 0, 0, 0, groupColors[g]});
+            }
+            visible[g].ForEachRect([&](const Bounds& r) {
+                batch.push_back({DeviceCommand::kRect, r.x0, r.y0, r.x1, r.y1, 0});
+            });
+        }
+        // Устройство должно остаться с последним заданным в кадре цветом
+        if (group > 0) {
+            batch.push_back({DeviceCommand::kColor, 0, 0, 0, 0, groupColors[group]});
+        }
+        if (raise) {
+            batch.push_back({DeviceCommand::kRaise, 0, 0, 0, 0, 0});
+        }
+        if (!batch.empty()) {
+            imp.DeviceSubmit(batch.data(), batch.size());
+        }
+    }
+};
+
 class XWindowImp : public WindowImp {
 public:
     void DeviceRaise() override {
@@ -53,16 +676,55 @@ public:
 class Window {
 protected:
     std::unique_ptr<WindowImp> imp; 
+    CommandBuffer commands;
+    bool inFrame = false;
+    bool trackDamage = false;
 
 public:
     Window(std::unique_ptr<WindowImp> imp) : imp(std::move(imp)) {}
 
     virtual void Raise() {
-        imp->DeviceRaise();
+        if (inFrame) {
+            commands.Raise();
+        } else {
+            imp->DeviceRaise();
+        }
     }
 
     virtual void DrawRect(int x0, int y0, int x1, int y1) {
-        imp->DeviceRect(x0, y0, x1, y1);
+        if (inFrame) {
+            commands.Rect(x0, y0, x1, y1);
+        } else {
+            imp->DeviceRect(x0, y0, x1, y1);
+        }
+    }
+
+    void SetColor(uint32_t rgba) {
+        if (inFrame) {
+            commands.Color(rgba);
+        } else {
+            imp->DeviceColor(rgba);
+        }
+    }
+
+    // Между BeginFrame и EndFrame операции записываются и уходят
+    // в устройство одним пакетом
+    void BeginFrame() {
+        inFrame = true;
+    }
+
+    void EndFrame() {
+        inFrame = false;
+        if (trackDamage) {
+            commands.SubmitDamage(*imp);
+        } else {
+            commands.Submit(*imp);
+        }
+    }
+
+    // Кадр уходит в устройство как свёрнутый регион повреждений
+    void SetDamageTracking(bool enabled) {
+        trackDamage = enabled;
     }
 
     virtual ~Window() = default;
@@ -108,7 +770,240 @@ public:
     }
 };
 
-int main() {
+// Устройство без вывода, считающее вызовы; каждый вызов стоит
+// фиксированную работу, как обращение к настоящему устройству.
+// Пакет принимается одним вызовом: фиксированная цена платится
+// один раз, а каждая команда пакета добавляет лишь свою обработку.
+class CountingWindowImp : public WindowImp {
+public:
+    size_t calls = 0;
+    size_t commands = 0;
+
+    void DeviceRaise() override {
+        Call();
+        commands++;
+    }
+
+    void DeviceRect(int, int, int, int) override {
+        Call();
+        commands++;
+    }
+
+    void DeviceSubmit(const DeviceCommand* batch, size_t count) override {
+        Call();
+        for (size_t i = 0; i < count; i++) {
+            sink += static_cast<uint64_t>(batch[i].kind) + static_cast<uint32_t>(batch[i].x1);
+        }
+        commands += count;
+    }
+
+private:
+    uint64_t sink = 0;
+
+    void Call() {
+        calls++;
+        for (int i = 0; i < 50; i++) {
+            sink += i;
+            asm volatile("" ::: "memory");
+        }
+    }
+};
+
+// Кадр из множества мелких прямоугольников: прямые вызовы против буфера
+void RunBenchmark(size_t rects, size_t frames) {
+    auto direct = std::make_unique<CountingWindowImp>();
+    auto buffered = std::make_unique<CountingWindowImp>();
+    CountingWindowImp* directImp = direct.get();
+    CountingWindowImp* bufferedImp = buffered.get();
+    ApplicationWindow directWindow(std::move(direct));
+    ApplicationWindow bufferedWindow(std::move(buffered));
+
+    auto drawFrame = [rects](Window& window) {
+        // Строки сетки из клеток 8x8 и подъём окна на каждой строке
+        for (size_t i = 0; i < rects; i++) {
+            int x = static_cast<int>(i % 128) * 8;
+            int y = static_cast<int>(i / 128) * 8;
+            window.DrawRect(x, y, x + 8, y + 8);
+            if (i % 128 == 0) {
+                window.Raise();
+            }
+        }
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        drawFrame(directWindow);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        bufferedWindow.BeginFrame();
+        drawFrame(bufferedWindow);
+        bufferedWindow.EndFrame();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << frames << " frames x " << rects << " rects: direct "
+              << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms ("
+              << directImp->calls << " device calls), buffered "
+              << std::chrono::duration<double, std::milli>(end - middle).count() << " ms ("
+              << bufferedImp->calls << " device calls, " << bufferedImp->commands
+              << " commands)" << std::endl;
+}
+
+// Скорость заливки: Мпикс/с для скалярной и SIMD-версий
+void RunFillBenchmark(int width, int height) {
+    struct Variant {
+        const char* name;
+        SpanFill fill;
+    };
+    std::vector<Variant> variants = {{"scalar", FillSpanScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+    variants.push_back({"sse2", FillSpanSSE2});
+    if (__builtin_cpu_supports("avx2")) {
+        variants.push_back({"avx2", FillSpanAVX2});
+    }
+#endif
+    for (int size : {16, 256, width}) {
+        std::cout << "Filling " << size << "px rects on " << width << "x" << height << ":";
+        for (const Variant& variant : variants) {
+            RasterWindowImp raster(width, height);
+            raster.SetSpanFill(variant.fill);
+            size_t pixels = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < 20; frame++) {
+                raster.DeviceColor(0xFF000000u | static_cast<uint32_t>(frame) * 0x010203u);
+                for (int y = 0; y < height; y += size) {
+                    for (int x = 0; x < width; x += size) {
+                        raster.DeviceRect(x, y, x + size, y + size);
+                    }
+                }
+                pixels += static_cast<size_t>(width) * height;
+            }
+            auto end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - begin).count();
+            std::cout << " " << variant.name << " " << static_cast<size_t>(pixels / seconds / 1e6) << " Mpix/s";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Кадр из множества случайных прямоугольников: последовательно и по плиткам
+void RunTiledBenchmark(int width, int height, size_t rectCount) {
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> x(0, width - 1);
+    std::uniform_int_distribution<int> y(0, height - 1);
+    std::uniform_int_distribution<int> extent(4, 256);
+
+    auto drawFrame = [&](Window& window) {
+        rng.seed(5);
+        window.BeginFrame();
+        for (size_t i = 0; i < rectCount; i++) {
+            if (i % 16 == 0) {
+                window.SetColor(0xFF000000u | static_cast<uint32_t>(rng()) >> 8);
+            }
+            int x0 = x(rng);
+            int y0 = y(rng);
+            window.DrawRect(x0, y0, x0 + extent(rng), y0 + extent(rng));
+        }
+        window.EndFrame();
+    };
+
+    auto serial = std::make_unique<RasterWindowImp>(width, height);
+    RasterWindowImp* serialImp = serial.get();
+    ApplicationWindow serialWindow(std::move(serial));
+    auto begin = std::chrono::steady_clock::now();
+    drawFrame(serialWindow);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << width << "x" << height << ", " << rectCount << " rects: serial "
+              << std::chrono::duration<double, std::milli>(end - begin).count() << " ms";
+
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        ThreadPool pool(threads);
+        auto tiled = std::make_unique<RasterWindowImp>(width, height);
+        RasterWindowImp* tiledImp = tiled.get();
+        tiledImp->SetThreadPool(&pool);
+        ApplicationWindow tiledWindow(std::move(tiled));
+        begin = std::chrono::steady_clock::now();
+        drawFrame(tiledWindow);
+        end = std::chrono::steady_clock::now();
+        std::cout << ", " << threads << " threads "
+                  << std::chrono::duration<double, std::milli>(end - begin).count() << " ms"
+                  << (tiledImp->Pixels() == serialImp->Pixels() ? "" : " (MISMATCH)");
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+    std::cout << std::endl;
+}
+
+// Программное устройство, считающее закрашенную площадь
+class OverdrawCountingImp : public RasterWindowImp {
+public:
+    using RasterWindowImp::RasterWindowImp;
+
+    size_t rects = 0;
+    long long area = 0;
+
+    void DeviceRect(int x0, int y0, int x1, int y1) override {
+        rects++;
+        area += static_cast<long long>(std::max(0, x1 - x0)) * std::max(0, y1 - y0);
+        RasterWindowImp::DeviceRect(x0, y0, x1, y1);
+    }
+};
+
+// Перерисовка с сильным перекрытием: все прямоугольники против региона повреждений
+void RunDamageBenchmark(int width, int height, size_t rectCount) {
+    auto drawFrame = [&](Window& window) {
+        std::mt19937 rng(9);
+        std::uniform_int_distribution<int> x(0, width - 1);
+        std::uniform_int_distribution<int> y(0, height - 1);
+        std::uniform_int_distribution<int> extent(32, 512);
+        window.BeginFrame();
+        for (size_t i = 0; i < rectCount; i++) {
+            if (i % 64 == 0) {
+                window.SetColor(0xFF000000u | static_cast<uint32_t>(i / 64 % 8) * 0x202020u);
+            }
+            int x0 = x(rng);
+            int y0 = y(rng);
+            window.DrawRect(x0, y0, x0 + extent(rng), y0 + extent(rng));
+        }
+        window.EndFrame();
+    };
+
+    std::cout << width << "x" << height << ", " << rectCount << " overlapping rects:";
+    std::vector<uint32_t> reference;
+    for (bool damage : {false, true}) {
+        auto imp = std::make_unique<OverdrawCountingImp>(width, height);
+        OverdrawCountingImp* counter = imp.get();
+        ApplicationWindow window(std::move(imp));
+        window.SetDamageTracking(damage);
+        auto begin = std::chrono::steady_clock::now();
+        drawFrame(window);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << (damage ? " damage " : " all ")
+                  << std::chrono::duration<double, std::milli>(end - begin).count() << " ms, "
+                  << counter->rects << " rects, " << counter->area / 1000000.0 << " Mpix sent;";
+        if (damage && counter->Pixels() != reference) {
+            std::cout << " (MISMATCH)";
+        }
+        reference = counter->Pixels();
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        RunBenchmark(16384, 200);
+        RunFillBenchmark(1920, 1080);
+        RunFillBenchmark(3840, 2160);
+        RunTiledBenchmark(3840, 2160, 50000);
+        RunTiledBenchmark(7680, 4320, 50000);
+        RunDamageBenchmark(1920, 1080, 2000);
+        RunDamageBenchmark(3840, 2160, 20000);
+        return 0;
+    }
+
     std::unique_ptr<WindowImp> xImp = std::make_unique<XWindowImp>();
     std::unique_ptr<WindowImp> pmImp = std::make_unique<PMWindowImp>();
     std::unique_ptr<WindowImp> macImp = std::make_unique<MacWindowImp>();
@@ -126,5 +1021,30 @@ int main() {
     dialogWindow.Lower();
     dialogWindow.Draw();
 
+    // Кадр: подряд идущие подъёмы сводятся к одному, стыкующиеся
+    // прямоугольники склеиваются, но не через подъём между ними
+    appWindow.BeginFrame();
+    appWindow.Raise();
+    appWindow.Raise();
+    appWindow.DrawRect(0, 0, 10, 10);
+    appWindow.DrawRect(10, 0, 20, 10);
+    appWindow.Raise();
+    appWindow.DrawRect(20, 0, 30, 10);
+    appWindow.EndFrame();
+
+    // Те же окна на программном устройстве; --ppm <файл> сохраняет кадр
+    auto raster = std::make_unique<RasterWindowImp>(200, 200);
+    RasterWindowImp* rasterImp = raster.get();
+    DialogWindow rasterDialog(std::move(raster), nullptr);
+    rasterDialog.SetColor(0xFF3060C0);
+    rasterDialog.Draw();
+    rasterDialog.SetColor(0xFF20A040);
+    rasterDialog.DrawRect(10, 10, 40, 40);
+    std::cout << "RasterWindowImp: pixel (60, 60) = 0x" << std::hex << rasterImp->Pixel(60, 60)
+              << ", pixel (5, 5) = 0x" << rasterImp->Pixel(5, 5) << std::dec << std::endl;
+    if (argc > 2 && std::strcmp(argv[1], "--ppm") == 0) {
+        rasterImp->WritePPM(argv[2]);
+    }
+
     return 0;
 }
\ No newline at end of file
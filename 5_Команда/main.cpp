@@ -1,5 +1,41 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cxxabi.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+class Journal;
+class EventLoop;
+class CommandTask;
 
 /**
  * Интерфейс Команды объявляет метод для выполнения команд.
@@ -9,6 +45,17 @@ class Command {
   virtual ~Command() {
   }
   virtual void Execute() const = 0;
+  /**
+   * Записывает команду в журнал; команды без записи не журналируются.
+   */
+  virtual void Record(Journal &) const {
+  }
+  /**
+   * Асинхронное выполнение в цикле событий. По умолчанию команда просто
+   * выполняется синхронно; команды с вводом-выводом переопределяют метод
+   * сопрограммой.
+   */
+  virtual CommandTask ExecuteAsync(EventLoop &loop) const;
 };
 /**
  * Некоторые команды способны выполнять простые операции самостоятельно.
@@ -23,6 +70,7 @@ class SimpleCommand : public Command {
   void Execute() const override {
     std::cout << "SimpleCommand: See, I can do simple things like printing (" << this->pay_load_ << ")\n";
   }
+  void Record(Journal &journal) const override;
 };
 
 /**
@@ -70,65 +118,1860 @@ class ComplexCommand : public Command {
     this->receiver_->DoSomething(this->a_);
     this->receiver_->DoSomethingElse(this->b_);
   }
+  void Record(Journal &journal) const override;
+  CommandTask ExecuteAsync(EventLoop &loop) const override;
 };
 
 /**
- * Отправитель связан с одной или несколькими командами. Он отправляет запрос
- * команде.
+ * Журнал выполненных команд. Каждая команда записывается компактной записью:
+ * байт тега и поля в виде длины (varint) и байтов. Записи копятся в пакете и
+ * попадают в отображённый в память файл одним кадром — это групповая
+ * фиксация: один кадр и одна синхронизация на много команд. Кадр начинается
+ * с длины и контрольной суммы, так что оборванный после сбоя хвост при
+ * чтении отбрасывается. Файл только дописывается.
+ *
+ * Все три отправителя (Invoker, AsyncInvoker, LoopInvoker) ведут его как
+ * журнал упреждающей записи: команда записывается, когда её берут на
+ * выполнение, и начинает выполняться только после Commit, включившего
+ * её запись. Поэтому каждая начатая команда уже есть в файле: она
+ * переживает падение процесса, а с журналом durable — и отказ питания.
+ * Асинхронные отправители фиксируют группой все команды, взятые на
+ * выполнение вместе; ошибка фиксации достаётся будущим этих команд.
  */
-class Invoker {
+class Journal {
+ public:
+  enum Tag : uint8_t { kSimple = 1, kComplex = 2, kCheckpoint = 3 };
+
+  static constexpr size_t kHeaderSize = 64;
+  static constexpr size_t kFrameHeaderSize = 8;
+  static constexpr size_t kGroupBytes = 64 * 1024;
+  static constexpr char kMagic[8] = {'C', 'M', 'D', 'J', 'R', 'N', 'L', '1'};
+
+  /**
+   * Число полей в записи с данным тегом.
+   */
+  static size_t FieldCount(uint8_t tag) {
+    switch (tag) {
+      case kSimple:
+      case kCheckpoint:
+        return 1;
+      case kComplex:
+        return 2;
+      default:
+        return 0;
+    }
+  }
+
+  static uint32_t Checksum(const char *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+  }
+
   /**
-   * @var Command
+   * Разбирает кадры начиная с offset и возвращает смещение за последним
+   * целым кадром; для каждого кадра вызывает visit(начало, размер).
    */
+  template <typename Visitor>
+  static size_t ScanFrames(const char *data, size_t size, size_t offset, Visitor &&visit) {
+    while (offset + kFrameHeaderSize <= size) {
+      uint32_t length;
+      uint32_t checksum;
+      std::memcpy(&length, data + offset, 4);
+      std::memcpy(&checksum, data + offset + 4, 4);
+      if (length == 0 || length > size - offset - kFrameHeaderSize ||
+          Checksum(data + offset + kFrameHeaderSize, length) != checksum) {
+        break;
+      }
+      visit(data + offset + kFrameHeaderSize, static_cast<size_t>(length));
+      offset += kFrameHeaderSize + length;
+    }
+    return offset;
+  }
+
  private:
-  Command *on_start_;
+  int fd_ = -1;
+  char *data_ = nullptr;
+  size_t mapped_ = 0;
+  size_t end_ = kHeaderSize;
+  bool durable_;
+  uint64_t records_ = 0;
+  std::string batch_;
+  std::mutex mutex_;
+
   /**
-   * @var Command
+   * Растит файл и отображение так, чтобы в них поместилось ещё bytes байт.
    */
-  Command *on_finish_;
+  void Reserve(size_t bytes) {
+    if (this->end_ + bytes <= this->mapped_) {
+      return;
+    }
+    size_t size = std::max<size_t>(this->mapped_ * 2, 1 << 20);
+    while (size < this->end_ + bytes) {
+      size *= 2;
+    }
+    if (::ftruncate(this->fd_, static_cast<off_t>(size)) != 0) {
+      throw std::system_error(errno, std::generic_category(), "ftruncate");
+    }
+    if (this->data_) {
+      ::munmap(this->data_, this->mapped_);
+    }
+    void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd_, 0);
+    if (data == MAP_FAILED) {
+      this->data_ = nullptr;
+      throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    this->data_ = static_cast<char *>(data);
+    this->mapped_ = size;
+  }
+
+  void PutVarint(size_t value) {
+    while (value >= 0x80) {
+      this->batch_.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    this->batch_.push_back(static_cast<char>(value));
+  }
+
+  void PutField(std::string_view field) {
+    this->PutVarint(field.size());
+    this->batch_.append(field.data(), field.size());
+  }
+
   /**
-   * Инициализация команд.
+   * Переносит накопленный пакет в файл одним кадром.
    */
+  void FlushLocked() {
+    if (this->batch_.empty()) {
+      return;
+    }
+    uint32_t length = static_cast<uint32_t>(this->batch_.size());
+    uint32_t checksum = Checksum(this->batch_.data(), this->batch_.size());
+    this->Reserve(kFrameHeaderSize + length);
+    char *frame = this->data_ + this->end_;
+    std::memcpy(frame + kFrameHeaderSize, this->batch_.data(), length);
+    std::memcpy(frame + 4, &checksum, 4);
+    std::memcpy(frame, &length, 4);
+    if (this->durable_) {
+      this->Sync(this->end_, kFrameHeaderSize + length);
+    }
+    this->end_ += kFrameHeaderSize + length;
+    this->batch_.clear();
+  }
+
+  void Sync(size_t offset, size_t size) {
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page * page;
+    if (::msync(this->data_ + begin, offset + size - begin, MS_SYNC) != 0) {
+      throw std::system_error(errno, std::generic_category(), "msync");
+    }
+  }
+
  public:
-  ~Invoker() {
-    delete on_start_;
-    delete on_finish_;
+  /**
+   * Открывает журнал для дописывания; существующий файл продолжается с
+   * последнего целого кадра. Если durable, каждая групповая фиксация
+   * дожидается записи на диск; иначе зафиксированный кадр лежит в
+   * страничном кэше и переживает падение процесса, но не системы.
+   */
+  explicit Journal(const char *path, bool durable = false) : durable_(durable) {
+    this->fd_ = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (this->fd_ < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat info;
+    if (::fstat(this->fd_, &info) != 0) {
+      int error = errno;
+      ::close(this->fd_);
+      throw std::system_error(error, std::generic_category(), path);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    // Новый журнал начинается только в пустом файле: чужой файл по ошибочному
+    // пути не должен быть ни отображён, ни обрезан
+    if (size > 0) {
+      char magic[sizeof(kMagic)];
+      if (size < kHeaderSize || ::pread(this->fd_, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic)) ||
+          std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        ::close(this->fd_);
+        throw std::runtime_error(std::string("not a command journal: ") + path);
+      }
+    }
+    this->Reserve(size > kHeaderSize ? size - kHeaderSize : 0);
+    if (size > 0) {
+      this->end_ = ScanFrames(this->data_, size, kHeaderSize, [](const char *, size_t) {});
+    } else {
+      std::memset(this->data_, 0, kHeaderSize);
+      std::memcpy(this->data_, kMagic, sizeof(kMagic));
+    }
   }
 
-  void SetOnStart(Command *command) {
-    this->on_start_ = command;
+  ~Journal() {
+    try {
+      this->Commit();
+    } catch (const std::system_error &error) {
+      std::cerr << "Journal: cannot commit the last batch: " << error.what() << '\n';
+    }
+    ::msync(this->data_, this->end_, MS_SYNC);
+    ::munmap(this->data_, this->mapped_);
+    if (::ftruncate(this->fd_, static_cast<off_t>(this->end_)) != 0) {
+      std::cerr << "Journal: cannot trim the log\n";
+    }
+    ::close(this->fd_);
   }
-  void SetOnFinish(Command *command) {
-    this->on_finish_ = command;
+
+  Journal(const Journal &) = delete;
+  Journal &operator=(const Journal &) = delete;
+
+  /**
+   * Добавляет запись в текущий пакет; заполненный пакет фиксируется сразу.
+   */
+  void Append(Tag tag, std::string_view a, std::string_view b = {}) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->batch_.push_back(static_cast<char>(tag));
+    this->PutField(a);
+    if (FieldCount(tag) > 1) {
+      this->PutField(b);
+    }
+    this->records_++;
+    if (this->batch_.size() >= kGroupBytes) {
+      this->FlushLocked();
+    }
   }
+
   /**
-   * Отправитель не зависит от классов конкретных команд и получателей.
-   * Отправитель передаёт запрос получателю косвенно, выполняя команду.
+   * Фиксирует накопленный пакет.
    */
-  void DoSomethingImportant() {
-    std::cout << "Invoker: Does anybody want something done before I begin?\n";
-    if (this->on_start_) {
-      this->on_start_->Execute();
+  void Commit() {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->FlushLocked();
+  }
+
+  /**
+   * Фиксирует пакет и ставит контрольную точку: всё записанное до неё
+   * считается применённым, и восстановление может начинаться с неё.
+   */
+  void Checkpoint() {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->FlushLocked();
+    uint64_t offset = this->end_;
+    char records[sizeof(this->records_)];
+    std::memcpy(records, &this->records_, sizeof(records));
+    this->batch_.push_back(static_cast<char>(kCheckpoint));
+    this->PutField(std::string_view(records, sizeof(records)));
+    this->FlushLocked();
+    std::memcpy(this->data_ + sizeof(kMagic), &offset, sizeof(offset));
+    this->Sync(0, this->end_);
+  }
+};
+
+/**
+ * Читает журнал и с полной скоростью перебирает записи, не копируя их:
+ * поля передаются как string_view на отображённый файл.
+ */
+class JournalReader {
+ private:
+  char *data_ = nullptr;
+  size_t size_ = 0;
+
+ public:
+  explicit JournalReader(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
     }
-    std::cout << "Invoker: ...doing something really important...\n";
-    std::cout << "Invoker: Does anybody want something done after I finish?\n";
-    if (this->on_finish_) {
-      this->on_finish_->Execute();
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), path);
     }
+    this->size_ = static_cast<size_t>(info.st_size);
+    if (this->size_ < Journal::kHeaderSize) {
+      ::close(fd);
+      throw std::runtime_error(std::string("not a command journal: ") + path);
+    }
+    void *data = ::mmap(nullptr, this->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      throw std::system_error(error, std::generic_category(), "mmap");
+    }
+    // Деструктор не вызывается для объекта, конструктор которого бросил,
+    // поэтому отображение освобождается здесь же
+    if (std::memcmp(data, Journal::kMagic, sizeof(Journal::kMagic)) != 0) {
+      ::munmap(data, this->size_);
+      throw std::runtime_error(std::string("not a command journal: ") + path);
+    }
+    this->data_ = static_cast<char *>(data);
+    ::madvise(this->data_, this->size_, MADV_SEQUENTIAL);
+  }
+
+  ~JournalReader() {
+    if (this->data_) {
+      ::munmap(this->data_, this->size_);
+    }
+  }
+
+  JournalReader(const JournalReader &) = delete;
+  JournalReader &operator=(const JournalReader &) = delete;
+
+  /**
+   * Вызывает visit(tag, fields) для каждой записи команды, начиная с начала
+   * журнала или с последней контрольной точки. Возвращает число записей.
+   */
+  template <typename Visitor>
+  size_t Replay(Visitor &&visit, bool from_checkpoint = false) const {
+    size_t offset = Journal::kHeaderSize;
+    if (from_checkpoint) {
+      uint64_t checkpoint;
+      std::memcpy(&checkpoint, this->data_ + sizeof(Journal::kMagic), sizeof(checkpoint));
+      if (checkpoint >= Journal::kHeaderSize && checkpoint <= this->size_) {
+        offset = static_cast<size_t>(checkpoint);
+      }
+    }
+    size_t count = 0;
+    Journal::ScanFrames(this->data_, this->size_, offset, [&](const char *frame, size_t size) {
+      const char *p = frame;
+      const char *end = frame + size;
+      std::string_view fields[2];
+      while (p < end) {
+        uint8_t tag = static_cast<uint8_t>(*p++);
+        size_t field_count = Journal::FieldCount(tag);
+        for (size_t i = 0; i < field_count; i++) {
+          size_t length = 0;
+          for (int shift = 0; p < end; shift += 7) {
+            // Длина не помещается в 64 бита: кадр испорчен, остаток пропускается
+            if (shift >= 64) {
+              return;
+            }
+            unsigned char byte = static_cast<unsigned char>(*p++);
+            length |= static_cast<size_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+              break;
+            }
+          }
+          length = std::min<size_t>(length, static_cast<size_t>(end - p));
+          fields[i] = std::string_view(p, length);
+          p += length;
+        }
+        if (field_count == 0) {
+          return;
+        }
+        if (tag != Journal::kCheckpoint) {
+          visit(tag, fields);
+          count++;
+        }
+      }
+    });
+    return count;
   }
 };
+
+void SimpleCommand::Record(Journal &journal) const {
+  journal.Append(Journal::kSimple, this->pay_load_);
+}
+
+void ComplexCommand::Record(Journal &journal) const {
+  journal.Append(Journal::kComplex, this->a_, this->b_);
+}
+
 /**
- * Клиентский код может параметризовать отправителя любыми командами.
+ * Восстановление: заново выполняет команды из журнала, направляя сложные
+ * команды указанному получателю.
  */
+size_t ReplayCommands(const JournalReader &reader, Receiver *receiver, bool from_checkpoint = false) {
+  return reader.Replay(
+      [receiver](uint8_t tag, const std::string_view *fields) {
+        if (tag == Journal::kSimple) {
+          SimpleCommand(std::string(fields[0])).Execute();
+        } else if (tag == Journal::kComplex) {
+          ComplexCommand(receiver, std::string(fields[0]), std::string(fields[1])).Execute();
+        }
+      },
+      from_checkpoint);
+}
 
-int main() {
-  Invoker *invoker = new Invoker;
-  invoker->SetOnStart(new SimpleCommand("Say Hi!"));
-  Receiver *receiver = new Receiver;
-  invoker->SetOnFinish(new ComplexCommand(receiver, "Send email", "Save report"));
-  invoker->DoSomethingImportant();
+/**
+ * Задача-сопрограмма асинхронной команды. Запускается лениво: при первом
+ * co_await или когда цикл событий возобновит её. По завершении управление
+ * сразу передаётся ожидающей сопрограмме.
+ */
+class CommandTask {
+ public:
+  struct promise_type {
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr error_;
+
+    CommandTask get_return_object() {
+      return CommandTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+    struct FinalAwaiter {
+      bool await_ready() noexcept {
+        return false;
+      }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation_;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+      void await_resume() noexcept {
+      }
+    };
+    FinalAwaiter final_suspend() noexcept {
+      return {};
+    }
+    void return_void() {
+    }
+    void unhandled_exception() {
+      this->error_ = std::current_exception();
+    }
+  };
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+
+ public:
+  explicit CommandTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {
+  }
+  CommandTask(CommandTask &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {
+  }
+  CommandTask &operator=(CommandTask &&other) noexcept {
+    if (this != &other) {
+      if (this->handle_) {
+        this->handle_.destroy();
+      }
+      this->handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  ~CommandTask() {
+    if (this->handle_) {
+      this->handle_.destroy();
+    }
+  }
+
+  std::coroutine_handle<> Handle() const {
+    return this->handle_;
+  }
+  bool Done() const {
+    return !this->handle_ || this->handle_.done();
+  }
+  /**
+   * Пробрасывает исключение, с которым завершилась сопрограмма.
+   */
+  void Result() const {
+    if (this->handle_ && this->handle_.promise().error_) {
+      std::rethrow_exception(this->handle_.promise().error_);
+    }
+  }
+
+  bool await_ready() const noexcept {
+    return this->Done();
+  }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    this->handle_.promise().continuation_ = awaiting;
+    return this->handle_;
+  }
+  void await_resume() const {
+    this->Result();
+  }
+};
+
+/**
+ * Цикл событий одного потока: очередь готовых сопрограмм и куча таймеров.
+ * Ставить сопрограммы в очередь можно из любого потока; таймеры заводят
+ * только сопрограммы, выполняющиеся в этом цикле.
+ */
+class EventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+  /**
+   * Задержка заглушки ввода-вывода: столько «идёт» запрос к удалённому
+   * сервису, плюс наносекунда на байт.
+   */
+  static constexpr std::chrono::milliseconds kIoLatency{1};
+
+ private:
+  struct Timer {
+    Clock::time_point deadline_;
+    std::coroutine_handle<> handle_;
+
+    bool operator>(const Timer &other) const {
+      return this->deadline_ > other.deadline_;
+    }
+  };
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::vector<std::coroutine_handle<>> inbox_;
+  std::vector<std::coroutine_handle<>> ready_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  bool stop_ = false;
+  /**
+   * Групповая фиксация: все записи, сделанные сопрограммами за проход цикла,
+   * фиксируются одним Commit на журнал, после чего сопрограммы продолжаются.
+   * Продолжившиеся могут снова ждать фиксации, поэтому повтор до опустения.
+   */
+  void CommitJournals() {
+    while (!this->committing_.empty()) {
+      this->committed_.swap(this->committing_);
+      for (size_t i = 0; i < this->committed_.size(); i++) {
+        JournalCommit *waiter = this->committed_[i];
+        bool first = true;
+        for (size_t j = 0; j < i && first; j++) {
+          first = this->committed_[j]->journal_ != waiter->journal_;
+        }
+        if (!first) {
+          continue;
+        }
+        std::exception_ptr error;
+        try {
+          waiter->journal_->Commit();
+        } catch (...) {
+          error = std::current_exception();
+        }
+        for (size_t j = i; j < this->committed_.size(); j++) {
+          if (this->committed_[j]->journal_ == waiter->journal_) {
+            this->committed_[j]->error_ = error;
+          }
+        }
+      }
+      for (JournalCommit *waiter : this->committed_) {
+        waiter->handle_.resume();
+      }
+      this->committed_.clear();
+    }
+  }
+
+  template <typename Done>
+  void Loop(Done done) {
+    for (;;) {
+      if (done()) {
+        return;
+      }
+      {
+        std::unique_lock<std::mutex> lock(this->mutex_);
+        auto has_work = [this] { return this->stop_ || !this->inbox_.empty(); };
+        if (this->timers_.empty()) {
+          this->wakeup_.wait(lock, has_work);
+        } else {
+          this->wakeup_.wait_until(lock, this->timers_.top().deadline_, has_work);
+        }
+        if (this->stop_ && this->inbox_.empty()) {
+          return;
+        }
+        this->ready_.swap(this->inbox_);
+      }
+      for (std::coroutine_handle<> handle : this->ready_) {
+        handle.resume();
+      }
+      this->ready_.clear();
+      Clock::time_point now = Clock::now();
+      while (!this->timers_.empty() && this->timers_.top().deadline_ <= now) {
+        std::coroutine_handle<> handle = this->timers_.top().handle_;
+        this->timers_.pop();
+        handle.resume();
+      }
+      this->CommitJournals();
+    }
+  }
+
+ public:
+  struct Delay {
+    EventLoop *loop_;
+    Clock::time_point deadline_;
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+      this->loop_->timers_.push({this->deadline_, handle});
+    }
+    void await_resume() const noexcept {
+    }
+  };
+
+  struct IoRequest : Delay {
+    size_t size_;
+
+    size_t await_resume() const noexcept {
+      return this->size_;
+    }
+  };
+
+  /**
+   * Ожидание фиксации журнала в конце текущего прохода цикла; ошибка
+   * фиксации выбрасывается в ожидающей сопрограмме.
+   */
+  struct JournalCommit {
+    EventLoop *loop_;
+    Journal *journal_;
+    std::coroutine_handle<> handle_ = nullptr;
+    std::exception_ptr error_ = nullptr;
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+      this->handle_ = handle;
+      this->loop_->committing_.push_back(this);
+    }
+    void await_resume() const {
+      if (this->error_) {
+        std::rethrow_exception(this->error_);
+      }
+    }
+  };
+
+ private:
+  std::vector<JournalCommit *> committing_;
+  std::vector<JournalCommit *> committed_;
+
+ public:
+
+  /**
+   * Возобновляет сопрограмму в этом цикле; можно вызывать из любого потока.
+   */
+  void Post(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->inbox_.push_back(handle);
+    }
+    this->wakeup_.notify_one();
+  }
+
+  Delay Sleep(Clock::duration duration) {
+    return {this, Clock::now() + duration};
+  }
+
+  JournalCommit Commit(Journal &journal) {
+    return {this, &journal};
+  }
+
+  /**
+   * Заглушка асинхронной записи в удалённый сервис для проверки без сети:
+   * завершается через kIoLatency и возвращает число «записанных» байт.
+   */
+  IoRequest Write(std::string_view data) {
+    return {{this, Clock::now() + kIoLatency + std::chrono::nanoseconds(data.size())}, data.size()};
+  }
+
+  /**
+   * Обрабатывает события, пока цикл не остановят через Stop.
+   */
+  void Run() {
+    this->Loop([] { return false; });
+  }
+
+  /**
+   * Выполняет задачу в текущем потоке до её завершения.
+   */
+  void RunUntilComplete(CommandTask &task) {
+    this->Post(task.Handle());
+    this->Loop([&task] { return task.Done(); });
+    task.Result();
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->stop_ = true;
+    }
+    this->wakeup_.notify_one();
+  }
+};
+
+CommandTask Command::ExecuteAsync(EventLoop &) const {
+  this->Execute();
+  co_return;
+}
+
+/**
+ * Письмо и отчёт отправляются через заглушку ввода-вывода: пока запрос
+ * «в пути», поток цикла обслуживает другие команды.
+ */
+CommandTask ComplexCommand::ExecuteAsync(EventLoop &loop) const {
+  std::cout << "ComplexCommand: Complex stuff should be done by a receiver object.\n";
+  co_await loop.Write(this->a_);
+  this->receiver_->DoSomething(this->a_);
+  co_await loop.Write(this->b_);
+  this->receiver_->DoSomethingElse(this->b_);
+}
+
+
+/**
+ * Команда-значение: хранит любую команду или вызываемый объект прямо во
+ * встроенном буфере, не обращаясь к куче. Объекты, которые в буфер не
+ * помещаются, переносятся в кучу. Такую команду можно только перемещать.
+ */
+class AnyCommand {
+ public:
+  /**
+   * Вместе с указателем на таблицу операций объект занимает 64 байта.
+   */
+  static constexpr size_t kInlineSize = 56;
+
+ private:
+  struct Ops {
+    void (*execute)(void *);
+    /**
+     * Переносит объект из from в неинициализированную память to и
+     * уничтожает исходный.
+     */
+    void (*move)(void *to, void *from);
+    void (*destroy)(void *);
+    void (*record)(const void *, Journal &);
+    const std::type_info *type;
+    CommandTask (*execute_async)(void *, EventLoop &);
+  };
+
+  template <typename T>
+  static void Call(T &target) {
+    if constexpr (std::is_base_of_v<Command, T>) {
+      target.Execute();
+    } else if constexpr (std::is_invocable_v<T &>) {
+      target();
+    } else {
+      EventLoop loop;
+      CommandTask task = target(loop);
+      loop.RunUntilComplete(task);
+    }
+  }
+
+  /**
+   * Обычный вызываемый объект выполняется как сопрограмма без приостановок.
+   */
+  template <typename T>
+  static CommandTask RunSync(T &target) {
+    target();
+    co_return;
+  }
+
+  template <typename T>
+  static CommandTask CallAsync(T &target, EventLoop &loop) {
+    if constexpr (std::is_base_of_v<Command, T>) {
+      return target.ExecuteAsync(loop);
+    } else if constexpr (std::is_invocable_r_v<CommandTask, T &, EventLoop &>) {
+      return target(loop);
+    } else {
+      return RunSync(target);
+    }
+  }
+
+  template <typename T>
+  static void Record(const T &target, Journal &journal) {
+    if constexpr (std::is_base_of_v<Command, T>) {
+      target.Record(journal);
+    }
+  }
+
+  template <typename T>
+  struct InlineOps {
+    static void Execute(void *storage) {
+      Call(*static_cast<T *>(storage));
+    }
+    static CommandTask ExecuteAsync(void *storage, EventLoop &loop) {
+      return CallAsync(*static_cast<T *>(storage), loop);
+    }
+    static void Move(void *to, void *from) {
+      T *source = static_cast<T *>(from);
+      new (to) T(std::move(*source));
+      source->~T();
+    }
+    static void Destroy(void *storage) {
+      static_cast<T *>(storage)->~T();
+    }
+    static void Record(const void *storage, Journal &journal) {
+      AnyCommand::Record(*static_cast<const T *>(storage), journal);
+    }
+    static constexpr Ops kOps = {&Execute, &Move, &Destroy, &Record, &typeid(T), &ExecuteAsync};
+  };
+
+  template <typename T>
+  struct HeapOps {
+    static T *&Get(void *storage) {
+      return *static_cast<T **>(storage);
+    }
+    static void Execute(void *storage) {
+      Call(*Get(storage));
+    }
+    static CommandTask ExecuteAsync(void *storage, EventLoop &loop) {
+      return CallAsync(*Get(storage), loop);
+    }
+    static void Move(void *to, void *from) {
+      new (to) T *(Get(from));
+    }
+    static void Destroy(void *storage) {
+      delete Get(storage);
+    }
+    static void Record(const void *storage, Journal &journal) {
+      AnyCommand::Record(**static_cast<T *const *>(storage), journal);
+    }
+    static constexpr Ops kOps = {&Execute, &Move, &Destroy, &Record, &typeid(T), &ExecuteAsync};
+  };
+
+  template <typename T>
+  static constexpr bool kFitsInline = sizeof(T) <= kInlineSize && alignof(T) <= alignof(std::max_align_t) &&
+                                      std::is_nothrow_move_constructible_v<T>;
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops *ops_ = nullptr;
+
+  void Reset() {
+    if (this->ops_) {
+      this->ops_->destroy(this->storage_);
+      this->ops_ = nullptr;
+    }
+  }
+
+ public:
+  AnyCommand() = default;
+
+  template <typename F, typename T = std::decay_t<F>,
+            typename = std::enable_if_t<!std::is_same_v<T, AnyCommand>>>
+  AnyCommand(F &&command) {
+    if constexpr (kFitsInline<T>) {
+      new (this->storage_) T(std::forward<F>(command));
+      this->ops_ = &InlineOps<T>::kOps;
+    } else {
+      new (this->storage_) T *(new T(std::forward<F>(command)));
+      this->ops_ = &HeapOps<T>::kOps;
+    }
+  }
+
+  AnyCommand(AnyCommand &&other) noexcept : ops_(other.ops_) {
+    if (this->ops_) {
+      this->ops_->move(this->storage_, other.storage_);
+      other.ops_ = nullptr;
+    }
+  }
+
+  AnyCommand &operator=(AnyCommand &&other) noexcept {
+    if (this != &other) {
+      this->Reset();
+      if (other.ops_) {
+        other.ops_->move(this->storage_, other.storage_);
+        this->ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  AnyCommand(const AnyCommand &) = delete;
+  AnyCommand &operator=(const AnyCommand &) = delete;
+
+  ~AnyCommand() {
+    this->Reset();
+  }
+
+  explicit operator bool() const {
+    return this->ops_ != nullptr;
+  }
+
+  void Execute() {
+    this->ops_->execute(this->storage_);
+  }
+
+  void Record(Journal &journal) const {
+    this->ops_->record(this->storage_, journal);
+  }
+
+  /**
+   * Задача для цикла событий; объект команды должен жить до её завершения.
+   */
+  CommandTask ExecuteAsync(EventLoop &loop) {
+    return this->ops_->execute_async(this->storage_, loop);
+  }
+
+  /**
+   * Тип хранимой команды или void для пустой.
+   */
+  const std::type_info &Type() const {
+    return this->ops_ ? *this->ops_->type : typeid(void);
+  }
+};
+
+/**
+ * Гистограмма задержек в духе HDR: каждая октава делится на 32 равных
+ * интервала, так что значение хранится с погрешностью не больше 3% при
+ * постоянной стоимости записи. Пишет в неё только поток-владелец, читать
+ * можно из любого потока.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBits = 5;
+  static constexpr size_t kSubBuckets = size_t(1) << kSubBits;
+  static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+ private:
+  std::atomic<uint64_t> counts_[kBuckets] = {};
+
+ public:
+  static size_t Index(uint64_t value) {
+    if (value < kSubBuckets) {
+      return static_cast<size_t>(value);
+    }
+    int shift = 63 - __builtin_clzll(value) - kSubBits;
+    return (static_cast<size_t>(shift) + 1) * kSubBuckets + static_cast<size_t>((value >> shift) - kSubBuckets);
+  }
+
+  /**
+   * Наибольшее значение, попадающее в интервал index.
+   */
+  static uint64_t Highest(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    int shift = static_cast<int>(index / kSubBuckets) - 1;
+    uint64_t lowest = static_cast<uint64_t>(index % kSubBuckets + kSubBuckets) << shift;
+    return lowest + ((uint64_t(1) << shift) - 1);
+  }
+
+  void Record(uint64_t value) {
+    std::atomic<uint64_t> &count = this->counts_[Index(value)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  void AddTo(std::vector<uint64_t> &totals) const {
+    for (size_t i = 0; i < kBuckets; i++) {
+      totals[i] += this->counts_[i].load(std::memory_order_relaxed);
+    }
+  }
+};
+
+/**
+ * Задержки выполнения по типам команд. Каждый поток пишет в собственные
+ * гистограммы без блокировок; при чтении они сливаются.
+ */
+class LatencyRecorder {
+ public:
+  struct Summary {
+    std::string name;
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+  };
+
+ private:
+  /**
+   * Гистограммы одного потока. Список типов растёт только в потоке-владельце
+   * и под мьютексом, поэтому владелец читает его без блокировки.
+   */
+  struct ThreadShards;
+
+  struct Shard {
+    std::mutex mutex_;
+    std::vector<std::pair<const std::type_info *, std::unique_ptr<LatencyHistogram>>> histograms_;
+    /** Кэш потока, в котором записан шард; под owners_mutex_. */
+    ThreadShards *owner_ = nullptr;
+  };
+
+  /**
+   * Кэш потока: идентификатор регистратора и его гистограммы в этом потоке.
+   * Идентификаторы не переиспользуются, поэтому запись от уничтоженного
+   * регистратора не спутать с новым по тому же адресу. Список читает и
+   * правит только сам поток; уничтоженный регистратор лишь оставляет свой
+   * идентификатор в retired_, и поток вычищает запись при следующем Record.
+   */
+  struct ThreadShards {
+    std::vector<std::pair<uint64_t, Shard *>> shards_;
+    std::atomic<bool> has_retired_{false};
+    /** Под owners_mutex_. */
+    std::vector<uint64_t> retired_;
+
+    void Prune() {
+      std::lock_guard<std::mutex> lock(owners_mutex_);
+      std::erase_if(this->shards_, [this](const auto &entry) {
+        return std::find(this->retired_.begin(), this->retired_.end(), entry.first) != this->retired_.end();
+      });
+      this->retired_.clear();
+      this->has_retired_.store(false, std::memory_order_relaxed);
+    }
+
+    /** Поток завершается: живые регистраторы больше не должны сюда писать. */
+    ~ThreadShards() {
+      std::lock_guard<std::mutex> lock(owners_mutex_);
+      for (const auto &entry : this->shards_) {
+        if (std::find(this->retired_.begin(), this->retired_.end(), entry.first) == this->retired_.end()) {
+          entry.second->owner_ = nullptr;
+        }
+      }
+    }
+  };
+
+  static inline std::atomic<uint64_t> next_id_{0};
+  static inline std::mutex owners_mutex_;
+
+  uint64_t id_ = next_id_.fetch_add(1, std::memory_order_relaxed);
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  Shard &LocalShard() {
+    static thread_local ThreadShards local;
+    if (local.has_retired_.load(std::memory_order_relaxed)) {
+      local.Prune();
+    }
+    for (const auto &entry : local.shards_) {
+      if (entry.first == this->id_) {
+        return *entry.second;
+      }
+    }
+    Shard *shard = new Shard;
+    shard->owner_ = &local;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->shards_.emplace_back(shard);
+    }
+    local.shards_.emplace_back(this->id_, shard);
+    return *shard;
+  }
+
+  static std::string Demangle(const std::type_info &type) {
+    int status = 0;
+    char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    std::string result = status == 0 ? name : type.name();
+    std::free(name);
+    return result;
+  }
+
+ public:
+  LatencyRecorder() = default;
+
+  /** Снимает свои шарды с кэшей ещё живых потоков. */
+  ~LatencyRecorder() {
+    std::lock_guard<std::mutex> lock(owners_mutex_);
+    for (const auto &shard : this->shards_) {
+      if (shard->owner_) {
+        shard->owner_->retired_.push_back(this->id_);
+        shard->owner_->has_retired_.store(true, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void Record(const std::type_info &type, uint64_t nanoseconds) {
+    Shard &shard = this->LocalShard();
+    for (const auto &entry : shard.histograms_) {
+      if (entry.first == &type || *entry.first == type) {
+        entry.second->Record(nanoseconds);
+        return;
+      }
+    }
+    LatencyHistogram *histogram = new LatencyHistogram;
+    histogram->Record(nanoseconds);
+    std::lock_guard<std::mutex> lock(shard.mutex_);
+    shard.histograms_.emplace_back(&type, histogram);
+  }
+
+  /**
+   * Сливает гистограммы всех потоков и возвращает сводку по каждому типу
+   * команд; значения в наносекундах.
+   */
+  std::vector<Summary> Snapshot() const {
+    std::vector<std::pair<const std::type_info *, std::vector<uint64_t>>> merged;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      for (const auto &shard : this->shards_) {
+        std::lock_guard<std::mutex> shard_lock(shard->mutex_);
+        for (const auto &entry : shard->histograms_) {
+          auto it = std::find_if(merged.begin(), merged.end(), [&entry](const auto &m) { return *m.first == *entry.first; });
+          if (it == merged.end()) {
+            merged.emplace_back(entry.first, std::vector<uint64_t>(LatencyHistogram::kBuckets));
+            it = merged.end() - 1;
+          }
+          entry.second->AddTo(it->second);
+        }
+      }
+    }
+
+    std::vector<Summary> summaries;
+    for (const auto &entry : merged) {
+      const std::vector<uint64_t> &counts = entry.second;
+      Summary summary = {Demangle(*entry.first), 0, 0, 0, 0, 0};
+      for (uint64_t count : counts) {
+        summary.count += count;
+      }
+      uint64_t *targets[] = {&summary.p50, &summary.p99, &summary.p999};
+      const double quantiles[] = {0.5, 0.99, 0.999};
+      uint64_t seen = 0;
+      size_t next = 0;
+      for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i] == 0) {
+          continue;
+        }
+        seen += counts[i];
+        while (next < 3 && seen >= quantiles[next] * summary.count) {
+          *targets[next++] = LatencyHistogram::Highest(i);
+        }
+        summary.max = LatencyHistogram::Highest(i);
+      }
+      summaries.push_back(summary);
+    }
+    return summaries;
+  }
+
+  void Dump(std::ostream &out) const {
+    for (const Summary &summary : this->Snapshot()) {
+      out << summary.name << ": count " << summary.count << ", p50 " << summary.p50 << " ns, p99 " << summary.p99
+          << " ns, p999 " << summary.p999 << " ns, max " << summary.max << " ns\n";
+    }
+  }
+};
+
+/**
+ * Выполняет команду, записывая её задержку, если задан регистратор.
+ */
+inline void ExecuteTimed(AnyCommand &command, LatencyRecorder *latency) {
+  if (!latency) {
+    command.Execute();
+    return;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  command.Execute();
+  auto end = std::chrono::steady_clock::now();
+  latency->Record(command.Type(), std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+}
+
+
+/**
+ * Отправитель связан с одной или несколькими командами. Он отправляет запрос
+ * команде.
+ */
+class Invoker {
+  /**
+   * @var AnyCommand
+   */
+ private:
+  AnyCommand on_start_;
+  /**
+   * @var AnyCommand
+   */
+  AnyCommand on_finish_;
+  /**
+   * @var Journal
+   */
+  Journal *journal_ = nullptr;
+  /**
+   * @var LatencyRecorder
+   */
+  LatencyRecorder *latency_ = nullptr;
+
+  /**
+   * Гарантию журнала см. у Journal; синхронный отправитель выполняет по
+   * одной команде, поэтому и фиксирует каждую отдельно.
+   */
+  void Run(AnyCommand &command) {
+    if (this->journal_) {
+      command.Record(*this->journal_);
+      this->journal_->Commit();
+    }
+    ExecuteTimed(command, this->latency_);
+  }
+  /**
+   * Инициализация команд.
+   */
+ public:
+  void SetOnStart(AnyCommand command) {
+    this->on_start_ = std::move(command);
+  }
+  void SetOnFinish(AnyCommand command) {
+    this->on_finish_ = std::move(command);
+  }
+  void SetJournal(Journal *journal) {
+    this->journal_ = journal;
+  }
+  /**
+   * Задержки команд и всего DoSomethingImportant (под типом Invoker).
+   */
+  void SetLatencyRecorder(LatencyRecorder *latency) {
+    this->latency_ = latency;
+  }
+  /**
+   * Отправитель не зависит от классов конкретных команд и получателей.
+   * Отправитель передаёт запрос получателю косвенно, выполняя команду.
+   */
+  void DoSomethingImportant() {
+    auto begin = std::chrono::steady_clock::now();
+    std::cout << "Invoker: Does anybody want something done before I begin?\n";
+    if (this->on_start_) {
+      this->Run(this->on_start_);
+    }
+    std::cout << "Invoker: ...doing something really important...\n";
+    std::cout << "Invoker: Does anybody want something done after I finish?\n";
+    if (this->on_finish_) {
+      this->Run(this->on_finish_);
+    }
+    if (this->latency_) {
+      auto elapsed = std::chrono::steady_clock::now() - begin;
+      this->latency_->Record(typeid(Invoker), std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  }
+};
+
+/**
+ * Ограниченная очередь для нескольких производителей и потребителей без
+ * блокировок (схема Вьюкова). Каждая ячейка хранит номер последовательности:
+ * по нему поток понимает, свободна ли ячейка для записи или уже заполнена для
+ * чтения, и захватывает её одним compare_exchange по своему счётчику.
+ */
+template <typename T>
+class MPMCQueue {
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence_;
+    T value_;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  /**
+   * Счётчики разнесены по разным кэш-линиям, чтобы производители и
+   * потребители не мешали друг другу.
+   */
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+ public:
+  /**
+   * Ёмкость округляется вверх до степени двойки.
+   */
+  explicit MPMCQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    this->cells_.reset(new Cell[size]);
+    this->mask_ = size - 1;
+    for (size_t i = 0; i < size; i++) {
+      this->cells_[i].sequence_.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool TryPush(T &value) {
+    size_t pos = this->enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = this->cells_[pos & this->mask_];
+      size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (this->enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value_ = std::move(value);
+          cell.sequence_.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = this->enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool TryPop(T &value) {
+    size_t pos = this->dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = this->cells_[pos & this->mask_];
+      size_t sequence = cell.sequence_.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (this->dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = std::move(cell.value_);
+          cell.sequence_.store(pos + this->mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = this->dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Приблизительная проверка: между вызовом и использованием результата
+   * другие потоки могут изменить очередь.
+   */
+  bool Empty() const {
+    return this->dequeue_pos_.load(std::memory_order_acquire) >= this->enqueue_pos_.load(std::memory_order_acquire);
+  }
+};
+
+/**
+ * Асинхронный отправитель: команды из любых потоков попадают в ограниченную
+ * очередь и выполняются пулом рабочих потоков.
+ */
+class AsyncInvoker {
+ private:
+  struct Task {
+    AnyCommand command_;
+    std::promise<void> *done_ = nullptr;
+  };
+
+  MPMCQueue<Task> queue_;
+  std::vector<std::thread> workers_;
+  /**
+   * Простаивающие рабочие засыпают на условной переменной; производитель
+   * будит их, только если кто-то действительно спит.
+   */
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::atomic<size_t> sleepers_{0};
+  std::atomic<size_t> pending_{0};
+  std::condition_variable idle_;
+  bool stop_ = false;
+  Journal *journal_ = nullptr;
+  LatencyRecorder *latency_ = nullptr;
+
+  /**
+   * Столько команд рабочий забирает из очереди под одну фиксацию журнала.
+   */
+  static constexpr size_t kJournalBatch = 64;
+
+  /**
+   * Выполняет команду; если failure задан, команда не выполняется, а её
+   * будущее получает эту ошибку.
+   */
+  void Run(Task &task, std::exception_ptr failure = nullptr) {
+    try {
+      if (failure) {
+        std::rethrow_exception(failure);
+      }
+      ExecuteTimed(task.command_, this->latency_);
+      if (task.done_) {
+        task.done_->set_value();
+      }
+    } catch (...) {
+      if (task.done_) {
+        task.done_->set_exception(std::current_exception());
+      }
+    }
+    task.command_ = AnyCommand();
+    delete task.done_;
+    if (this->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->idle_.notify_all();
+    }
+  }
+
+  /**
+   * Групповая фиксация: рабочий забирает из очереди всё готовое (до
+   * kJournalBatch команд), записывает пакет, фиксирует его одним Commit и
+   * только потом выполняет команды пакета.
+   */
+  void RunJournaled(Task &first, std::vector<Task> &batch) {
+    batch.clear();
+    batch.push_back(std::move(first));
+    Task next;
+    while (batch.size() < kJournalBatch && this->queue_.TryPop(next)) {
+      batch.push_back(std::move(next));
+    }
+    std::exception_ptr failure;
+    try {
+      for (Task &task : batch) {
+        task.command_.Record(*this->journal_);
+      }
+      this->journal_->Commit();
+    } catch (...) {
+      failure = std::current_exception();
+    }
+    for (Task &task : batch) {
+      this->Run(task, failure);
+    }
+  }
+
+  void Work() {
+    Task task;
+    std::vector<Task> batch;
+    for (;;) {
+      /**
+       * Перед сном рабочий сначала крутится, а потом уступает процессор: при
+       * плотном потоке команд это дешевле, чем засыпать и просыпаться.
+       */
+      bool found = false;
+      for (int spin = 0; spin < 64 && !found; spin++) {
+        found = this->queue_.TryPop(task);
+      }
+      for (int spin = 0; spin < 16 && !found; spin++) {
+        std::this_thread::yield();
+        found = this->queue_.TryPop(task);
+      }
+      if (found) {
+        if (this->journal_) {
+          this->RunJournaled(task, batch);
+        } else {
+          this->Run(task);
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      this->wakeup_.wait(lock, [this] { return this->stop_ || !this->queue_.Empty(); });
+      this->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      if (this->stop_ && this->queue_.Empty()) {
+        return;
+      }
+    }
+  }
+
+  void Enqueue(Task &&task) {
+    this->pending_.fetch_add(1, std::memory_order_relaxed);
+    while (!this->queue_.TryPush(task)) {
+      std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->sleepers_.load(std::memory_order_seq_cst) > 0) {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+      }
+      this->wakeup_.notify_one();
+    }
+  }
+
+ public:
+  explicit AsyncInvoker(size_t workers = std::thread::hardware_concurrency(), size_t capacity = 4096)
+      : queue_(capacity) {
+    for (size_t i = 0; i < std::max<size_t>(workers, 1); i++) {
+      this->workers_.emplace_back([this] { this->Work(); });
+    }
+  }
+
+  /**
+   * Дожидается выполнения всех поставленных команд и останавливает рабочих.
+   */
+  ~AsyncInvoker() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->stop_ = true;
+    }
+    this->wakeup_.notify_all();
+    for (std::thread &worker : this->workers_) {
+      worker.join();
+    }
+  }
+
+  /**
+   * Ставит команду в очередь; будущее завершится после её выполнения или
+   * передаст исключение, выброшенное Execute.
+   */
+  std::future<void> Submit(AnyCommand command) {
+    std::promise<void> *done = new std::promise<void>;
+    std::future<void> result = done->get_future();
+    this->Enqueue({std::move(command), done});
+    return result;
+  }
+
+  /**
+   * Журнал для выполняемых команд (гарантию см. у Journal); задаётся до
+   * постановки первой команды.
+   */
+  void SetJournal(Journal *journal) {
+    this->journal_ = journal;
+  }
+
+  /**
+   * Регистратор задержек выполнения; задаётся до постановки первой команды.
+   */
+  void SetLatencyRecorder(LatencyRecorder *latency) {
+    this->latency_ = latency;
+  }
+
+  /**
+   * Ставит команду в очередь без ожидания результата.
+   */
+  void Post(AnyCommand command) {
+    this->Enqueue({std::move(command), nullptr});
+  }
+
+  /**
+   * Ждёт, пока не будут выполнены все уже поставленные команды.
+   */
+  void Wait() {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->idle_.wait(lock, [this] { return this->pending_.load(std::memory_order_acquire) == 0; });
+  }
+};
+
+/**
+ * Отправитель для асинхронных команд: сопрограммы команд распределяются по
+ * нескольким циклам событий, каждый в своём потоке. Пока команда ждёт
+ * ввода-вывода или таймера, поток обслуживает другие, поэтому тысячи
+ * команд в работе делят несколько потоков.
+ */
+class LoopInvoker {
+ private:
+  /**
+   * Корневая сопрограмма: держит команду и её обещание, а по завершении
+   * уничтожает себя сама.
+   */
+  struct RootTask {
+    struct promise_type {
+      RootTask get_return_object() {
+        return {std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+      std::suspend_always initial_suspend() noexcept {
+        return {};
+      }
+      std::suspend_never final_suspend() noexcept {
+        return {};
+      }
+      void return_void() {
+      }
+      void unhandled_exception() {
+        std::terminate();
+      }
+    };
+
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+  std::vector<std::unique_ptr<EventLoop>> loops_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_{0};
+  std::atomic<size_t> pending_{0};
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  Journal *journal_ = nullptr;
+  LatencyRecorder *latency_ = nullptr;
+
+  /**
+   * Команда записывается в журнал, когда цикл берёт её на выполнение, и
+   * начинает работу только после групповой фиксации своего прохода цикла.
+   */
+  static RootTask Run(LoopInvoker *self, AnyCommand command, EventLoop *loop, std::promise<void> done) {
+    auto begin = std::chrono::steady_clock::now();
+    try {
+      if (self->journal_) {
+        command.Record(*self->journal_);
+        co_await loop->Commit(*self->journal_);
+      }
+      co_await command.ExecuteAsync(*loop);
+      done.set_value();
+    } catch (...) {
+      done.set_exception(std::current_exception());
+    }
+    if (self->latency_) {
+      auto elapsed = std::chrono::steady_clock::now() - begin;
+      self->latency_->Record(command.Type(), std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    if (self->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      self->idle_.notify_all();
+    }
+  }
+
+ public:
+  explicit LoopInvoker(size_t threads = 2) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+      this->loops_.emplace_back(new EventLoop);
+      this->threads_.emplace_back([loop = this->loops_.back().get()] { loop->Run(); });
+    }
+  }
+
+  /**
+   * Дожидается завершения всех команд и останавливает циклы.
+   */
+  ~LoopInvoker() {
+    this->Wait();
+    for (auto &loop : this->loops_) {
+      loop->Stop();
+    }
+    for (std::thread &thread : this->threads_) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Журнал для выполняемых команд (гарантию см. у Journal); задаётся до
+   * постановки первой команды.
+   */
+  void SetJournal(Journal *journal) {
+    this->journal_ = journal;
+  }
+
+  /**
+   * Задержка команды здесь — время от запуска до завершения сопрограммы,
+   * включая ожидание ввода-вывода.
+   */
+  void SetLatencyRecorder(LatencyRecorder *latency) {
+    this->latency_ = latency;
+  }
+
+  std::future<void> Submit(AnyCommand command) {
+    std::promise<void> done;
+    std::future<void> result = done.get_future();
+    EventLoop *loop = this->loops_[this->next_.fetch_add(1, std::memory_order_relaxed) % this->loops_.size()].get();
+    this->pending_.fetch_add(1, std::memory_order_relaxed);
+    loop->Post(Run(this, std::move(command), loop, std::move(done)).handle_);
+    return result;
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->idle_.wait(lock, [this] { return this->pending_.load(std::memory_order_acquire) == 0; });
+  }
+};
+
+/**
+ * Команда для замера пропускной способности: только увеличивает счётчик.
+ */
+class CountCommand : public Command {
+ private:
+  std::atomic<size_t> *counter_;
+
+ public:
+  explicit CountCommand(std::atomic<size_t> *counter) : counter_(counter) {
+  }
+  void Execute() const override {
+    this->counter_->fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+/**
+ * Пропускная способность асинхронного отправителя при разном числе
+ * производителей и рабочих.
+ */
+void RunBenchmark(size_t commands) {
+  const size_t counts[] = {1, 2, 4};
+  for (size_t producers : counts) {
+    for (size_t consumers : counts) {
+      std::atomic<size_t> counter{0};
+      auto begin = std::chrono::steady_clock::now();
+      {
+        AsyncInvoker invoker(consumers);
+        std::vector<std::thread> threads;
+        for (size_t p = 0; p < producers; p++) {
+          threads.emplace_back([&invoker, &counter, commands, producers] {
+            for (size_t i = 0; i < commands / producers; i++) {
+              invoker.Post(CountCommand(&counter));
+            }
+          });
+        }
+        for (std::thread &thread : threads) {
+          thread.join();
+        }
+        invoker.Wait();
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      std::cout << producers << " producers, " << consumers << " workers: " << counter.load() / seconds / 1e6
+                << " M commands/s\n";
+    }
+  }
+
+  std::atomic<size_t> counter{0};
+  AsyncInvoker invoker(4);
+  std::vector<std::future<void>> futures;
+  futures.reserve(commands / 4);
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < commands / 4; i++) {
+    futures.push_back(invoker.Submit(CountCommand(&counter)));
+  }
+  for (std::future<void> &future : futures) {
+    future.get();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << "with futures, 4 workers: " << counter.load() / seconds / 1e6 << " M commands/s\n";
+}
+
+/**
+ * Создание и выполнение мелких команд: объект в куче против команды-значения.
+ */
+void RunValueBenchmark(size_t commands) {
+  std::atomic<size_t> counter{0};
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < commands; i++) {
+    std::unique_ptr<Command> command(new CountCommand(&counter));
+    command->Execute();
+  }
+  auto middle = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < commands; i++) {
+    AnyCommand command = CountCommand(&counter);
+    command.Execute();
+  }
+  auto end = std::chrono::steady_clock::now();
+  std::cout << commands << " small commands: heap "
+            << std::chrono::duration<double, std::milli>(middle - begin).count() << " ms, inline "
+            << std::chrono::duration<double, std::milli>(end - middle).count() << " ms\n";
+}
+
+/**
+ * Запись команд в журнал, групповая фиксация против фиксации каждой команды
+ * и скорость воспроизведения.
+ */
+void RunJournalBenchmark(const char *path, size_t commands) {
+  std::remove(path);
+  AnyCommand command = SimpleCommand("Say Hi!");
+  auto begin = std::chrono::steady_clock::now();
+  {
+    Journal journal(path);
+    for (size_t i = 0; i < commands; i++) {
+      command.Record(journal);
+      if (i == commands / 2) {
+        journal.Checkpoint();
+      }
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - begin).count();
+  std::cout << commands << " journaled commands: " << commands / seconds / 1e6 << " M records/s\n";
+
+  {
+    JournalReader reader(path);
+    begin = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    size_t replayed = reader.Replay([&bytes](uint8_t, const std::string_view *fields) { bytes += fields[0].size(); });
+    end = std::chrono::steady_clock::now();
+    seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "  replay: " << replayed / seconds / 1e6 << " M records/s, from checkpoint "
+              << reader.Replay([](uint8_t, const std::string_view *) {}, true) << " records\n";
+  }
+
+  const size_t durable_commands = 2000;
+  for (bool grouped : {false, true}) {
+    std::remove(path);
+    begin = std::chrono::steady_clock::now();
+    {
+      Journal journal(path, true);
+      for (size_t i = 0; i < durable_commands; i++) {
+        command.Record(journal);
+        if (!grouped) {
+          journal.Commit();
+        }
+      }
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "  " << durable_commands << " durable commands, " << (grouped ? "group commit " : "commit each ")
+              << std::chrono::duration<double, std::milli>(end - begin).count() << " ms\n";
+  }
+  std::remove(path);
+}
+
+/**
+ * Стоимость записи задержек и сводка по смеси быстрых и изредка медленных
+ * команд на нескольких рабочих.
+ */
+void RunLatencyBenchmark(size_t commands) {
+  std::atomic<size_t> counter{0};
+  LatencyRecorder overhead;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < commands; i++) {
+    AnyCommand command = CountCommand(&counter);
+    ExecuteTimed(command, nullptr);
+  }
+  auto middle = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < commands; i++) {
+    AnyCommand command = CountCommand(&counter);
+    ExecuteTimed(command, &overhead);
+  }
+  auto end = std::chrono::steady_clock::now();
+  std::cout << commands << " commands: untimed " << std::chrono::duration<double, std::milli>(middle - begin).count()
+            << " ms, timed " << std::chrono::duration<double, std::milli>(end - middle).count() << " ms\n";
+
+  LatencyRecorder latency;
+  {
+    AsyncInvoker invoker(4);
+    invoker.SetLatencyRecorder(&latency);
+    for (size_t i = 0; i < commands / 10; i++) {
+      invoker.Post(CountCommand(&counter));
+      if (i % 1000 == 0) {
+        invoker.Post([] { std::this_thread::sleep_for(std::chrono::microseconds(50)); });
+      }
+    }
+    invoker.Wait();
+  }
+  latency.Dump(std::cout);
+}
+
+/**
+ * Команды, которые ждут ввода-вывода: сопрограммы на двух циклах событий
+ * против блокирующих команд на пуле из четырёх рабочих.
+ */
+void RunCoroutineBenchmark(size_t commands) {
+  const auto wait = std::chrono::milliseconds(10);
+  auto begin = std::chrono::steady_clock::now();
+  {
+    LoopInvoker invoker(2);
+    for (size_t i = 0; i < commands; i++) {
+      invoker.Submit([wait](EventLoop &loop) -> CommandTask {
+        co_await loop.Sleep(wait);
+        co_await loop.Write("report");
+      });
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << commands << " coroutine commands on 2 threads: " << seconds * 1e3 << " ms, " << commands / seconds
+            << " commands/s\n";
+
+  const size_t blocking = 400;
+  begin = std::chrono::steady_clock::now();
+  {
+    AsyncInvoker invoker(4);
+    for (size_t i = 0; i < blocking; i++) {
+      invoker.Post([wait] {
+        std::this_thread::sleep_for(wait + EventLoop::kIoLatency);
+      });
+    }
+    invoker.Wait();
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << blocking << " blocking commands on 4 threads: " << seconds * 1e3 << " ms, " << blocking / seconds
+            << " commands/s\n";
+}
+
+/**
+ * Клиентский код может параметризовать отправителя любыми командами.
+ */
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+    RunBenchmark(2000000);
+    RunValueBenchmark(10000000);
+    RunJournalBenchmark("commands.journal.bench", 5000000);
+    RunLatencyBenchmark(10000000);
+    RunCoroutineBenchmark(100000);
+    return 0;
+  }
+
+  const char *journal_path = nullptr;
+  if (argc > 2 && std::strcmp(argv[1], "--journal") == 0) {
+    journal_path = argv[2];
+  }
+  std::unique_ptr<Journal> journal;
+  if (journal_path) {
+    journal.reset(new Journal(journal_path));
+  }
+
+  Invoker *invoker = new Invoker;
+  invoker->SetOnStart(SimpleCommand("Say Hi!"));
+  Receiver *receiver = new Receiver;
+  invoker->SetOnFinish(ComplexCommand(receiver, "Send email", "Save report"));
+  invoker->SetJournal(journal.get());
+  invoker->DoSomethingImportant();
+
+  delete invoker;
+
+  if (journal) {
+    journal.reset();
+    JournalReader reader(journal_path);
+    std::cout << "Journal: replaying\n";
+    size_t replayed = ReplayCommands(reader, receiver);
+    std::cout << "Journal: replayed " << replayed << " commands\n";
+  }
+
+  AsyncInvoker async_invoker(2);
+  async_invoker.Submit(SimpleCommand("Say Hi asynchronously!")).get();
+  async_invoker.Submit(ComplexCommand(receiver, "Send email", "Save report")).get();
+  async_invoker.Submit([receiver] { receiver->DoSomething("Print invoice"); }).get();
+
+  LoopInvoker loop_invoker(1);
+  loop_invoker.Submit(ComplexCommand(receiver, "Send email", "Save report")).get();
 
-  delete invoker;
   delete receiver;
 
   return 0;
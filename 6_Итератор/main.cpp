@@ -1,17 +1,116 @@
 #include <iostream>
 #include <vector>
 #include <stack>
+#include <cstring>
+#include <charconv>
+#include <cerrno>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <span>
 
 // Предварительное объявление шаблонного класса Iterator
 template <typename T>
 class Iterator;
 
+// Приёмник отрисовки: глифы пишут текст сюда, а не в std::cout
+// Дословная копия RenderSink и FdRenderSink; каноническая копия - в
+// 1_Стратегия/main.cpp (примеры собираются по одному файлу). Правки
+// вносятся там и переносятся во все копии.
+class RenderSink {
+    public:
+        virtual void Write(const char* data, size_t size) = 0;
+        virtual void Flush() {}
+        virtual ~RenderSink() = default;
+
+        RenderSink& operator<<(const char* text) {
+            Write(text, std::strlen(text));
+            return *this;
+        }
+
+        RenderSink& operator<<(char ch) {
+            Write(&ch, 1);
+            return *this;
+        }
+
+        RenderSink& operator<<(size_t value) {
+            char digits[20];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            Write(digits, result.ptr - digits);
+            return *this;
+        }
+};
+
+// Копит вывод в большом буфере и отдаёт его одним write(2), когда буфер
+// заполнен, при Flush() и в деструкторе - без сброса на каждый глиф
+class FdRenderSink : public RenderSink {
+    private:
+        int fd;
+        std::vector<char> buffer;
+        size_t used = 0;
+
+        void writeAll(const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return;
+                }
+                data += written;
+                size -= written;
+            }
+        }
+
+    public:
+        explicit FdRenderSink(int fd = STDOUT_FILENO, size_t capacity = 1 << 16)
+            : fd(fd), buffer(capacity) {}
+
+        void Write(const char* data, size_t size) override {
+            if (used + size > buffer.size()) {
+                Flush();
+                if (size >= buffer.size()) {
+                    writeAll(data, size);
+                    return;
+                }
+            }
+            std::memcpy(buffer.data() + used, data, size);
+            used += size;
+        }
+
+        void Flush() override {
+            writeAll(buffer.data(), used);
+            used = 0;
+        }
+
+        ~FdRenderSink() {
+            Flush();
+        }
+};
+
 // Базовый класс Glyph
 class Glyph {
 public:
     virtual ~Glyph() {}
-    virtual void Draw() = 0;
+    virtual void Draw(RenderSink& sink) = 0;
     virtual Iterator<Glyph*>* CreateIterator() = 0;
+
+    // Потомки составного глифа или nullptr для листа - доступ к ним без
+    // создания итератора
+    virtual const std::vector<Glyph*>* Children() const { return nullptr; }
 };
 
 // Базовый класс Iterator
@@ -66,10 +165,10 @@ class Row : public Glyph {
 private:
     std::vector<Glyph*> children;
 public:
-    void Draw() override {
-        std::cout << "Drawing Row" << std::endl;
+    void Draw(RenderSink& sink) override {
+        sink << "Drawing Row\n";
         for (auto child : children) {
-            child->Draw();
+            child->Draw(sink);
         }
     }
 
@@ -77,10 +176,25 @@ public:
         children.push_back(glyph);
     }
 
+    void Insert(size_t position, Glyph* glyph) {
+        children.insert(children.begin() + position, glyph);
+    }
+
+    // Извлекает потомка; владение переходит к вызывающему
+    Glyph* Remove(size_t position) {
+        Glyph* glyph = children[position];
+        children.erase(children.begin() + position);
+        return glyph;
+    }
+
     Iterator<Glyph*>* CreateIterator() override {
         return new ListIterator<Glyph*>(children);
     }
 
+    const std::vector<Glyph*>* Children() const override {
+        return &children;
+    }
+
     ~Row() {
         for (auto child : children) {
             delete child;
@@ -155,6 +269,807 @@ public:
     }
 };
 
+// Кадр обхода: список потомков и позиция в нём
+struct TraversalFrame {
+    const std::vector<Glyph*>* children;
+    size_t index;
+};
+
+// Прямой обход без выделения памяти на шаге: вместо итератора на каждый узел
+// хранит стек кадров (потомки, индекс). Стек переиспользуется между обходами,
+// так что после первого прохода по дереву такой глубины память не выделяется.
+class StackPreorderIterator : public Iterator<Glyph*> {
+private:
+    std::vector<TraversalFrame> frames;
+    Glyph* root;
+
+    void pushChildren(Glyph* glyph) {
+        const std::vector<Glyph*>* children = glyph->Children();
+        if (children && !children->empty()) {
+            frames.push_back({children, 0});
+        }
+    }
+
+public:
+    StackPreorderIterator(Glyph* root) : root(root) {}
+
+    void Reset(Glyph* newRoot) {
+        root = newRoot;
+        frames.clear();
+    }
+
+    void First() override {
+        frames.clear();
+        pushChildren(root);
+    }
+
+    void Next() override {
+        if (frames.empty()) return;
+
+        size_t depth = frames.size();
+        pushChildren(CurrentItem());
+        if (frames.size() > depth) {
+            return;
+        }
+
+        // Потомков нет - переходим к следующему узлу на этом уровне или выше
+        while (!frames.empty() && ++frames.back().index >= frames.back().children->size()) {
+            frames.pop_back();
+        }
+    }
+
+    bool IsDone() const override {
+        return frames.empty();
+    }
+
+    Glyph* CurrentItem() const override {
+        if (frames.empty()) return nullptr;
+        const TraversalFrame& top = frames.back();
+        return (*top.children)[top.index];
+    }
+};
+
+// Тот же обход без виртуального вызова на шаг: visit встраивается в цикл.
+// Корень, как и у итераторов, не посещается.
+template <typename Visit>
+void ForEachPreorder(Glyph* root, std::vector<TraversalFrame>& frames, Visit&& visit) {
+    frames.clear();
+    const std::vector<Glyph*>* children = root->Children();
+    if (children && !children->empty()) {
+        frames.push_back({children, 0});
+    }
+    while (!frames.empty()) {
+        TraversalFrame& top = frames.back();
+        Glyph* current = (*top.children)[top.index];
+        if (++top.index >= top.children->size()) {
+            frames.pop_back();
+        }
+        visit(current);
+        children = current->Children();
+        if (children && !children->empty()) {
+            frames.push_back({children, 0});
+        }
+    }
+}
+
+// Плоское представление дерева глифов: узлы в прямом порядке, по столбцу на
+// поле (SoA). sizes[i] - размер поддерева узла i вместе с ним, так что
+// поддерево занимает отрезок [i, i + sizes[i]), а следующий брат узла i
+// стоит в позиции i + sizes[i]. Полный обход и обход поддерева - линейные
+// проходы по массивам. Корень лежит в позиции 0 и, как у итераторов, при
+// обходе не посещается. Глифами по-прежнему владеет дерево из Row.
+class FlatGlyphTree {
+public:
+    enum Kind : uint8_t { kLeaf = 0, kRow = 1 };
+
+private:
+    std::vector<Glyph*> glyphs;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> depths;
+    std::vector<uint8_t> kinds;
+
+    struct BuildFrame {
+        const std::vector<Glyph*>* children;
+        size_t index;
+        size_t node;
+    };
+    std::vector<BuildFrame> frames;
+    std::vector<size_t> path;
+
+    // Дописывает поддерево glyph в конец массивов
+    void append(Glyph* glyph, uint32_t depth) {
+        frames.clear();
+        size_t node = glyphs.size();
+        push(glyph, depth);
+        const std::vector<Glyph*>* children = glyph->Children();
+        if (!children || children->empty()) {
+            sizes[node] = 1;
+            return;
+        }
+        frames.push_back({children, 0, node});
+        while (!frames.empty()) {
+            BuildFrame& top = frames.back();
+            if (top.index == top.children->size()) {
+                sizes[top.node] = static_cast<uint32_t>(glyphs.size() - top.node);
+                frames.pop_back();
+                continue;
+            }
+            Glyph* child = (*top.children)[top.index++];
+            size_t childNode = glyphs.size();
+            uint32_t childDepth = static_cast<uint32_t>(depths[top.node] + 1);
+            push(child, childDepth);
+            const std::vector<Glyph*>* grandChildren = child->Children();
+            if (grandChildren && !grandChildren->empty()) {
+                frames.push_back({grandChildren, 0, childNode});
+            } else {
+                sizes[childNode] = 1;
+            }
+        }
+    }
+
+    void push(Glyph* glyph, uint32_t depth) {
+        glyphs.push_back(glyph);
+        sizes.push_back(1);
+        depths.push_back(depth);
+        kinds.push_back(glyph->Children() ? kRow : kLeaf);
+    }
+
+    // Предки узла index от корня, не включая сам узел: спуск по ссылкам на
+    // следующего брата, O(глубина * ширина строки)
+    void findPath(size_t index) {
+        path.clear();
+        size_t node = 0;
+        while (node != index) {
+            path.push_back(node);
+            size_t child = node + 1;
+            while (child + sizes[child] <= index) {
+                child += sizes[child];
+            }
+            node = child;
+        }
+    }
+
+    void addToAncestors(long delta) {
+        for (size_t ancestor : path) {
+            sizes[ancestor] = static_cast<uint32_t>(static_cast<long>(sizes[ancestor]) + delta);
+        }
+    }
+
+public:
+    void Build(Glyph* root) {
+        glyphs.clear();
+        sizes.clear();
+        depths.clear();
+        kinds.clear();
+        append(root, 0);
+    }
+
+    size_t Size() const { return glyphs.size(); }
+    Glyph* GlyphAt(size_t index) const { return glyphs[index]; }
+    uint32_t SubtreeSize(size_t index) const { return sizes[index]; }
+    uint32_t Depth(size_t index) const { return depths[index]; }
+    Kind KindAt(size_t index) const { return static_cast<Kind>(kinds[index]); }
+    const std::vector<uint8_t>& Kinds() const { return kinds; }
+
+    // Следующий брат узла или конец поддерева его родителя
+    size_t NextSibling(size_t index) const { return index + sizes[index]; }
+
+    template <typename Visit>
+    void ForEach(Visit&& visit) const {
+        for (size_t i = 1; i < glyphs.size(); i++) {
+            visit(glyphs[i]);
+        }
+    }
+
+    // Потомки узла index в прямом порядке, без него самого
+    template <typename Visit>
+    void ForEachInSubtree(size_t index, Visit&& visit) const {
+        for (size_t i = index + 1, end = index + sizes[index]; i < end; i++) {
+            visit(glyphs[i]);
+        }
+    }
+
+    // Вставляет glyph потомком номер position в строку, лежащую в позиции
+    // row, и вписывает его поддерево в массивы на месте, без перестройки.
+    // Правка сдвигает хвосты всех четырёх столбцов, поэтому стоит O(N) от
+    // размера дерева (плюс спуск к строке); это один memmove на столбец, а
+    // не перестройка, но при частых правках большого документа плоское
+    // дерево лучше перестраивать пакетно. Возвращает false, если row - не
+    // строка или position больше числа её потомков.
+    bool Insert(size_t row, size_t position, Glyph* glyph) {
+        if (!glyph || row >= glyphs.size() || kinds[row] != kRow) {
+            return false;
+        }
+        Row* parent = dynamic_cast<Row*>(glyphs[row]);
+        if (!parent || position > parent->Children()->size()) {
+            return false;
+        }
+        size_t at = row + 1;
+        for (size_t i = 0; i < position; i++) {
+            at += sizes[at];
+        }
+        parent->Insert(position, glyph);
+
+        // Поддерево строится в хвосте массивов и поворачивается на место
+        size_t tail = glyphs.size();
+        append(glyph, static_cast<uint32_t>(depths[row] + 1));
+        size_t count = glyphs.size() - tail;
+        std::rotate(glyphs.begin() + at, glyphs.begin() + tail, glyphs.end());
+        std::rotate(sizes.begin() + at, sizes.begin() + tail, sizes.end());
+        std::rotate(depths.begin() + at, depths.begin() + tail, depths.end());
+        std::rotate(kinds.begin() + at, kinds.begin() + tail, kinds.end());
+
+        findPath(row);
+        path.push_back(row);
+        addToAncestors(static_cast<long>(count));
+        return true;
+    }
+
+    // Удаляет узел index вместе с поддеревом из дерева и из массивов; как и
+    // вставка, стоит O(N). Корень удалить нельзя: для него и для индекса за
+    // концом возвращается false.
+    bool Remove(size_t index) {
+        if (index == 0 || index >= glyphs.size()) {
+            return false;
+        }
+        findPath(index);
+        size_t parent = path.back();
+        size_t position = 0;
+        for (size_t child = parent + 1; child != index; child += sizes[child]) {
+            position++;
+        }
+        delete static_cast<Row*>(glyphs[parent])->Remove(position);
+
+        size_t count = sizes[index];
+        glyphs.erase(glyphs.begin() + index, glyphs.begin() + index + count);
+        sizes.erase(sizes.begin() + index, sizes.begin() + index + count);
+        depths.erase(depths.begin() + index, depths.begin() + index + count);
+        kinds.erase(kinds.begin() + index, kinds.begin() + index + count);
+        addToAncestors(-static_cast<long>(count));
+        return true;
+    }
+};
+
+// Параллельная свёртка дерева глифов с сохранением порядка документа.
+// Работа делится по границам строк: поддерево вложенной строки становится
+// отдельной задачей, которую может украсть другой поток. Задача собирает
+// свою часть документа в список отрезков: частичный результат своих узлов
+// или место для результата порождённой задачи. Так combine применяется в
+// порядке документа и может быть некоммутативным, но должен быть
+// ассоциативным, а identity - его нейтральным элементом. Потоки-помощники
+// создаются один раз и переживают вызовы Reduce.
+template <typename T>
+class ParallelGlyphReducer {
+private:
+    struct Result;
+
+    struct Segment {
+        T value;
+        Result* child;
+    };
+
+    struct Result {
+        std::vector<Segment> segments;
+    };
+
+    struct Task {
+        const std::vector<Glyph*>* children;
+        Result* result;
+    };
+
+    // Своя очередь задач у каждого потока: владелец берёт с конца, воры - с
+    // начала. Результаты порождённых задач хранит поток, который их породил.
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<size_t> queued{0};
+        std::deque<Result> results;
+        // Узлы, свёрнутые этим потоком за последний вызов
+        size_t visited = 0;
+    };
+
+    // Задание вызова Reduce без типов map и combine: помощники живут
+    // дольше одного вызова
+    struct Job {
+        void (*run)(void* context, size_t self);
+        void* context;
+    };
+
+    // Пока в своей очереди меньше задач, вложенные строки отдаются на кражу;
+    // иначе обходятся на месте
+    static constexpr size_t kSpawnThreshold = 4;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> pending{0};
+
+    std::vector<std::thread> helpers;
+    std::mutex jobMutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    Job job{};
+    size_t generation = 0;
+    // Помощники, ещё не вышедшие из текущего задания. Reduce ждёт, пока
+    // каждый возьмёт задание и выйдет из него, поэтому ни один помощник не
+    // прочтёт контекст вызова после возврата
+    size_t running = 0;
+    bool stopping = false;
+
+    void helperLoop(size_t self) {
+        size_t seen = 0;
+        for (;;) {
+            Job current;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                jobReady.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+                current = job;
+            }
+            current.run(current.context, self);
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (--running == 0) {
+                jobDone.notify_one();
+            }
+        }
+    }
+
+    bool pop(size_t self, Task& task) {
+        Worker& worker = *workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            return false;
+        }
+        task = worker.tasks.back();
+        worker.tasks.pop_back();
+        worker.queued.store(worker.tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(size_t self, Task& task) {
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                victim.queued.store(victim.tasks.size(), std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Map, typename Combine>
+    void run(size_t self, const Task& task, const T& identity, Map& map, Combine& combine) {
+        Worker& worker = *workers[self];
+        std::vector<TraversalFrame> frames;
+        frames.push_back({task.children, 0});
+        T partial = identity;
+        while (!frames.empty()) {
+            TraversalFrame& top = frames.back();
+            Glyph* current = (*top.children)[top.index];
+            if (++top.index >= top.children->size()) {
+                frames.pop_back();
+            }
+            partial = combine(partial, map(current));
+            worker.visited++;
+
+            const std::vector<Glyph*>* children = current->Children();
+            if (!children || children->empty()) {
+                continue;
+            }
+            if (worker.queued.load(std::memory_order_relaxed) < kSpawnThreshold) {
+                worker.results.emplace_back();
+                Result* child = &worker.results.back();
+                task.result->segments.push_back({partial, nullptr});
+                task.result->segments.push_back({identity, child});
+                partial = identity;
+                pending.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.tasks.push_back({children, child});
+                worker.queued.store(worker.tasks.size(), std::memory_order_relaxed);
+            } else {
+                frames.push_back({children, 0});
+            }
+        }
+        task.result->segments.push_back({partial, nullptr});
+    }
+
+    template <typename Map, typename Combine>
+    void work(size_t self, const T& identity, Map& map, Combine& combine) {
+        Task task;
+        while (pending.load(std::memory_order_acquire) > 0) {
+            if (pop(self, task) || steal(self, task)) {
+                run(self, task, identity, map, combine);
+                pending.fetch_sub(1, std::memory_order_acq_rel);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    template <typename Combine>
+    static T fold(const Result& result, const T& identity, Combine& combine) {
+        T value = identity;
+        for (const Segment& segment : result.segments) {
+            value = combine(value, segment.child ? fold(*segment.child, identity, combine) : segment.value);
+        }
+        return value;
+    }
+
+public:
+    // threads - число потоков вместе с вызывающим Reduce
+    explicit ParallelGlyphReducer(size_t threads) {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+            workers.emplace_back(new Worker);
+        }
+        for (size_t i = 1; i < workers.size(); i++) {
+            helpers.emplace_back([this, i] { helperLoop(i); });
+        }
+    }
+
+    ParallelGlyphReducer(const ParallelGlyphReducer&) = delete;
+    ParallelGlyphReducer& operator=(const ParallelGlyphReducer&) = delete;
+
+    ~ParallelGlyphReducer() {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (std::thread& helper : helpers) {
+            helper.join();
+        }
+    }
+
+    size_t Threads() const { return workers.size(); }
+
+    // Сколько узлов свернул поток worker (0 - вызывающий) в последнем Reduce
+    size_t Visited(size_t worker) const { return workers[worker]->visited; }
+
+    // Сворачивает map(glyph) по всем узлам под root (без него самого) в
+    // прямом порядке; вызывающий поток работает наравне с помощниками.
+    // Вызовы Reduce одного объекта не должны пересекаться.
+    template <typename Map, typename Combine>
+    T Reduce(Glyph* root, T identity, Map map, Combine combine) {
+        const std::vector<Glyph*>* children = root->Children();
+        if (!children || children->empty()) {
+            return identity;
+        }
+        for (auto& worker : workers) {
+            worker->results.clear();
+            worker->visited = 0;
+        }
+        Result rootResult;
+        workers[0]->tasks.push_back({children, &rootResult});
+        pending.store(1, std::memory_order_relaxed);
+
+        struct Context {
+            ParallelGlyphReducer* reducer;
+            const T* identity;
+            Map* map;
+            Combine* combine;
+        };
+        Context context{this, &identity, &map, &combine};
+        if (!helpers.empty()) {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            job = {[](void* data, size_t self) {
+                Context& c = *static_cast<Context*>(data);
+                c.reducer->work(self, *c.identity, *c.map, *c.combine);
+            }, &context};
+            generation++;
+            running = helpers.size();
+        }
+        jobReady.notify_all();
+        work(0, identity, map, combine);
+        if (!helpers.empty()) {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobDone.wait(lock, [this] { return running == 0; });
+        }
+        return fold(rootResult, identity, combine);
+    }
+};
+
+struct NoResult {};
+
+// Параллельный обход без результата на потоках reducer; visit вызывается
+// из разных потоков
+template <typename Visit>
+void ParallelForEach(ParallelGlyphReducer<NoResult>& reducer, Glyph* root, Visit visit) {
+    reducer.Reduce(
+        root, NoResult(),
+        [&visit](Glyph* glyph) {
+            visit(glyph);
+            return NoResult();
+        },
+        [](NoResult, NoResult) { return NoResult(); });
+}
+
+// Итераторы обхода в стиле стандартной библиотеки: модели
+// std::forward_iterator без виртуального вызова на шаг, пригодные для
+// <algorithm> и std::ranges. Корень, как и у итераторов выше, не посещается.
+// Разыменование возвращает ссылку на элемент вектора потомков строки.
+
+// Прямой порядок: стек кадров (потомки, индекс), вершина - текущий узел
+class PreorderGlyphIterator {
+private:
+    std::vector<TraversalFrame> frames;
+
+public:
+    using value_type = Glyph*;
+    using difference_type = std::ptrdiff_t;
+    using reference = Glyph* const&;
+    using iterator_category = std::forward_iterator_tag;
+
+    PreorderGlyphIterator() = default;
+
+    explicit PreorderGlyphIterator(Glyph* root) {
+        const std::vector<Glyph*>* children = root->Children();
+        if (children && !children->empty()) {
+            frames.push_back({children, 0});
+        }
+    }
+
+    reference operator*() const {
+        const TraversalFrame& top = frames.back();
+        return (*top.children)[top.index];
+    }
+
+    PreorderGlyphIterator& operator++() {
+        const std::vector<Glyph*>* children = (**this)->Children();
+        if (children && !children->empty()) {
+            frames.push_back({children, 0});
+            return *this;
+        }
+        while (!frames.empty() && ++frames.back().index >= frames.back().children->size()) {
+            frames.pop_back();
+        }
+        return *this;
+    }
+
+    PreorderGlyphIterator operator++(int) {
+        PreorderGlyphIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const PreorderGlyphIterator& other) const {
+        return frames.size() == other.frames.size() &&
+               std::equal(frames.begin(), frames.end(), other.frames.begin(),
+                          [](const TraversalFrame& a, const TraversalFrame& b) {
+                              return a.children == b.children && a.index == b.index;
+                          });
+    }
+};
+
+// Обратный порядок: потомки раньше своей строки. Текущий узел - вершина
+// стека; после последнего потомка кадр снимается, и вершиной становится
+// сама строка.
+class PostorderGlyphIterator {
+private:
+    std::vector<TraversalFrame> frames;
+
+    // Спускается к первому листу поддерева текущего узла
+    void descend() {
+        for (;;) {
+            const std::vector<Glyph*>* children = (**this)->Children();
+            if (!children || children->empty()) {
+                return;
+            }
+            frames.push_back({children, 0});
+        }
+    }
+
+public:
+    using value_type = Glyph*;
+    using difference_type = std::ptrdiff_t;
+    using reference = Glyph* const&;
+    using iterator_category = std::forward_iterator_tag;
+
+    PostorderGlyphIterator() = default;
+
+    explicit PostorderGlyphIterator(Glyph* root) {
+        const std::vector<Glyph*>* children = root->Children();
+        if (children && !children->empty()) {
+            frames.push_back({children, 0});
+            descend();
+        }
+    }
+
+    reference operator*() const {
+        const TraversalFrame& top = frames.back();
+        return (*top.children)[top.index];
+    }
+
+    PostorderGlyphIterator& operator++() {
+        if (++frames.back().index < frames.back().children->size()) {
+            descend();
+        } else {
+            frames.pop_back();
+        }
+        return *this;
+    }
+
+    PostorderGlyphIterator operator++(int) {
+        PostorderGlyphIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const PostorderGlyphIterator& other) const {
+        return frames.size() == other.frames.size() &&
+               std::equal(frames.begin(), frames.end(), other.frames.begin(),
+                          [](const TraversalFrame& a, const TraversalFrame& b) {
+                              return a.children == b.children && a.index == b.index;
+                          });
+    }
+};
+
+// Обход в ширину: очередь списков потомков в порядке посещения строк и
+// позиция (список, индекс) в ней. Списки не снимаются с очереди, поэтому
+// копия итератора продолжает обход независимо.
+class BreadthFirstGlyphIterator {
+private:
+    std::vector<const std::vector<Glyph*>*> lists;
+    size_t list = 0;
+    size_t index = 0;
+
+    bool atEnd() const {
+        return list >= lists.size();
+    }
+
+public:
+    using value_type = Glyph*;
+    using difference_type = std::ptrdiff_t;
+    using reference = Glyph* const&;
+    using iterator_category = std::forward_iterator_tag;
+
+    BreadthFirstGlyphIterator() = default;
+
+    explicit BreadthFirstGlyphIterator(Glyph* root) {
+        const std::vector<Glyph*>* children = root->Children();
+        if (children && !children->empty()) {
+            lists.push_back(children);
+        }
+    }
+
+    reference operator*() const {
+        return (*lists[list])[index];
+    }
+
+    BreadthFirstGlyphIterator& operator++() {
+        const std::vector<Glyph*>* children = (**this)->Children();
+        if (children && !children->empty()) {
+            lists.push_back(children);
+        }
+        if (++index >= lists[list]->size()) {
+            list++;
+            index = 0;
+        }
+        return *this;
+    }
+
+    BreadthFirstGlyphIterator operator++(int) {
+        BreadthFirstGlyphIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const BreadthFirstGlyphIterator& other) const {
+        if (atEnd() || other.atEnd()) {
+            return atEnd() == other.atEnd();
+        }
+        return lists[list] == other.lists[other.list] && index == other.index;
+    }
+};
+
+// Пакетный режим: непрерывные отрезки подряд идущих листьев одной строки в
+// прямом порядке. Отрезок указывает прямо в вектор потомков строки, так что
+// его можно обработать плотным циклом. Лист от строки отличает только
+// виртуальный Children(), поэтому на каждый узел приходится ровно один
+// виртуальный вызов; без них обходится лишь скан FlatGlyphTree::Kinds().
+class LeafSpanIterator {
+private:
+    std::vector<TraversalFrame> frames;
+    std::span<Glyph* const> current;
+    // Children() строки, на которой оборвался отрезок листьев: следующий
+    // шаг начинается с неё и не опрашивает её повторно
+    const std::vector<Glyph*>* stopped = nullptr;
+
+    // Находит следующий отрезок, начиная с позиции вершины стека
+    void advance() {
+        while (!frames.empty()) {
+            TraversalFrame& top = frames.back();
+            if (top.index >= top.children->size()) {
+                frames.pop_back();
+                continue;
+            }
+            const std::vector<Glyph*>* children = stopped ? stopped : (*top.children)[top.index]->Children();
+            stopped = nullptr;
+            if (!children) {
+                size_t begin = top.index;
+                while (++top.index < top.children->size() &&
+                       !(stopped = (*top.children)[top.index]->Children())) {
+                }
+                current = std::span<Glyph* const>(top.children->data() + begin, top.index - begin);
+                return;
+            }
+            top.index++;
+            if (!children->empty()) {
+                frames.push_back({children, 0});
+            }
+        }
+        current = {};
+    }
+
+public:
+    // Разыменование возвращает span по значению, а не ссылку, поэтому для
+    // классических алгоритмов это лишь input-итератор; std::ranges видят
+    // forward_iterator
+    using value_type = std::span<Glyph* const>;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::span<Glyph* const>;
+    using iterator_concept = std::forward_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+
+    LeafSpanIterator() = default;
+
+    explicit LeafSpanIterator(Glyph* root) {
+        const std::vector<Glyph*>* children = root->Children();
+        if (children && !children->empty()) {
+            frames.push_back({children, 0});
+        }
+        advance();
+    }
+
+    reference operator*() const {
+        return current;
+    }
+
+    LeafSpanIterator& operator++() {
+        advance();
+        return *this;
+    }
+
+    LeafSpanIterator operator++(int) {
+        LeafSpanIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const LeafSpanIterator& other) const {
+        return current.data() == other.current.data() && current.size() == other.current.size();
+    }
+};
+
+// Представление обхода дерева: begin() и end() одного типа, так что его
+// можно передавать и в std::ranges, и в классические алгоритмы
+template <typename GlyphIterator>
+class GlyphView : public std::ranges::view_interface<GlyphView<GlyphIterator>> {
+private:
+    Glyph* root = nullptr;
+
+public:
+    GlyphView() = default;
+    explicit GlyphView(Glyph* root) : root(root) {}
+
+    GlyphIterator begin() const { return GlyphIterator(root); }
+    GlyphIterator end() const { return GlyphIterator(); }
+};
+
+using PreorderView = GlyphView<PreorderGlyphIterator>;
+using PostorderView = GlyphView<PostorderGlyphIterator>;
+using BreadthFirstView = GlyphView<BreadthFirstGlyphIterator>;
+using LeafSpanView = GlyphView<LeafSpanIterator>;
+
+static_assert(std::forward_iterator<PreorderGlyphIterator>);
+static_assert(std::forward_iterator<PostorderGlyphIterator>);
+static_assert(std::forward_iterator<BreadthFirstGlyphIterator>);
+static_assert(std::forward_iterator<LeafSpanIterator>);
+static_assert(std::ranges::forward_range<PreorderView> && std::ranges::view<PreorderView>);
+
 // Конкретный глиф Character
 class Character : public Glyph {
 private:
@@ -162,16 +1077,428 @@ private:
 public:
     Character(char ch) : ch(ch) {}
 
-    void Draw() override {
-        std::cout << "Drawing Character: " << ch << std::endl;
+    void Draw(RenderSink& sink) override {
+        sink << "Drawing Character: " << ch << '\n';
     }
 
     Iterator<Glyph*>* CreateIterator() override {
         return new NullIterator<Glyph*>();
     }
+
+    char GetChar() const {
+        return ch;
+    }
 };
 
-int main() {
+// Строит дерево: в каждой строке fanout потомков, каждый четвёртый из них -
+// вложенная строка, пока не достигнута глубина depth
+Row* BuildTree(size_t fanout, size_t depth) {
+    Row* row = new Row();
+    for (size_t i = 0; i < fanout; i++) {
+        if (depth > 1 && i % 4 == 0) {
+            row->Add(BuildTree(fanout, depth - 1));
+        } else {
+            row->Add(new Character(static_cast<char>('a' + i % 26)));
+        }
+    }
+    return row;
+}
+
+// Случайное дерево: строки, в том числе пустые, вперемешку с листьями
+Row* BuildRandomTree(std::mt19937& random, size_t depth) {
+    Row* row = new Row();
+    size_t fanout = random() % 6;
+    for (size_t i = 0; i < fanout; i++) {
+        if (depth > 1 && random() % 3 == 0) {
+            row->Add(BuildRandomTree(random, depth - 1));
+        } else {
+            row->Add(new Character(static_cast<char>('a' + random() % 26)));
+        }
+    }
+    return row;
+}
+
+// Эталонные обходы рекурсией; корень, как и у представлений, не входит
+void CollectPreorder(Glyph* glyph, std::vector<Glyph*>& out) {
+    for (Glyph* child : *glyph->Children()) {
+        out.push_back(child);
+        if (child->Children()) {
+            CollectPreorder(child, out);
+        }
+    }
+}
+
+void CollectPostorder(Glyph* glyph, std::vector<Glyph*>& out) {
+    for (Glyph* child : *glyph->Children()) {
+        if (child->Children()) {
+            CollectPostorder(child, out);
+        }
+        out.push_back(child);
+    }
+}
+
+void CollectLeafRuns(Glyph* glyph, std::vector<std::span<Glyph* const>>& out) {
+    const std::vector<Glyph*>& children = *glyph->Children();
+    for (size_t i = 0; i < children.size();) {
+        if (children[i]->Children()) {
+            CollectLeafRuns(children[i++], out);
+            continue;
+        }
+        size_t begin = i;
+        while (i < children.size() && !children[i]->Children()) {
+            i++;
+        }
+        out.emplace_back(children.data() + begin, i - begin);
+    }
+}
+
+// Свёртка, чувствительная к порядку: полиномиальный хеш документа и число
+// узлов. Совпадение с последовательным обходом проверяет, что
+// ParallelGlyphReducer склеивает части в порядке документа.
+struct OrderedHash {
+    uint64_t hash;
+    uint64_t power;
+    size_t count;
+};
+
+OrderedHash HashGlyph(Glyph* glyph) {
+    uint64_t code = glyph->Children() ? '[' : static_cast<Character*>(glyph)->GetChar();
+    return OrderedHash{code, 131, 1};
+}
+
+OrderedHash CombineHashes(OrderedHash a, OrderedHash b) {
+    return OrderedHash{a.hash * b.power + b.hash, a.power * b.power, a.count + b.count};
+}
+
+// Сверяет представления с рекурсивными обходами на случайных деревьях
+bool CheckViews(size_t trees) {
+    std::mt19937 random(2024);
+    for (size_t t = 0; t < trees; t++) {
+        Row* root = BuildRandomTree(random, 1 + random() % 6);
+        std::vector<Glyph*> preorder;
+        std::vector<Glyph*> postorder;
+        std::vector<Glyph*> breadthFirst;
+        std::vector<std::span<Glyph* const>> runs;
+        CollectPreorder(root, preorder);
+        CollectPostorder(root, postorder);
+        for (std::vector<Glyph*> level{root}; !level.empty();) {
+            std::vector<Glyph*> next;
+            for (Glyph* glyph : level) {
+                if (glyph->Children()) {
+                    for (Glyph* child : *glyph->Children()) {
+                        breadthFirst.push_back(child);
+                        next.push_back(child);
+                    }
+                }
+            }
+            level.swap(next);
+        }
+        CollectLeafRuns(root, runs);
+
+        std::vector<std::span<Glyph* const>> spans(LeafSpanView(root).begin(), LeafSpanView(root).end());
+        bool match = std::ranges::equal(PreorderView(root), preorder) &&
+                     std::ranges::equal(PostorderView(root), postorder) &&
+                     std::ranges::equal(BreadthFirstView(root), breadthFirst) &&
+                     std::ranges::equal(spans, runs, [](std::span<Glyph* const> a, std::span<Glyph* const> b) {
+                         return a.data() == b.data() && a.size() == b.size();
+                     });
+        delete root;
+        if (!match) {
+            std::cout << "views differ from reference traversals on tree " << t << std::endl;
+            return false;
+        }
+    }
+    std::cout << "views match reference traversals on " << trees << " random trees" << std::endl;
+    return true;
+}
+
+bool SameFlatTree(const FlatGlyphTree& a, const FlatGlyphTree& b) {
+    if (a.Size() != b.Size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.Size(); i++) {
+        if (a.GlyphAt(i) != b.GlyphAt(i) || a.SubtreeSize(i) != b.SubtreeSize(i) ||
+            a.Depth(i) != b.Depth(i) || a.KindAt(i) != b.KindAt(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Сверяет FlatGlyphTree после случайных Insert/Remove с деревом, заново
+// построенным по той же Row, и проверяет глубину больше 65535
+bool CheckFlatEdits(size_t trees) {
+    std::mt19937 random(2025);
+    FlatGlyphTree flat;
+    FlatGlyphTree rebuilt;
+    for (size_t t = 0; t < trees; t++) {
+        Row* root = BuildRandomTree(random, 1 + random() % 6);
+        flat.Build(root);
+        bool match = true;
+        for (size_t edit = 0; edit < 16 && match; edit++) {
+            if (random() % 2 && flat.Size() > 1) {
+                match = flat.Remove(1 + random() % (flat.Size() - 1));
+            } else {
+                // Лист в роли строки и позиция за концом должны отвергаться
+                size_t row = random() % flat.Size();
+                const std::vector<Glyph*>* children = flat.GlyphAt(row)->Children();
+                size_t limit = children ? children->size() : 0;
+                size_t position = random() % (limit + 2);
+                Glyph* glyph = random() % 2 ? static_cast<Glyph*>(BuildRandomTree(random, 3))
+                                            : new Character('+');
+                bool accepted = children && position <= limit;
+                if (flat.Insert(row, position, glyph) != accepted) {
+                    match = false;
+                }
+                if (!accepted) {
+                    delete glyph;
+                }
+            }
+            rebuilt.Build(root);
+            match = match && SameFlatTree(flat, rebuilt);
+        }
+        delete root;
+        if (!match) {
+            std::cout << "flat tree edits differ from a rebuild on tree " << t << std::endl;
+            return false;
+        }
+    }
+
+    // Цепочка вложенных строк глубже диапазона uint16_t; разбирается
+    // вручную, чтобы рекурсивный ~Row не упёрся в стек
+    const size_t depth = 70000;
+    std::vector<Row*> rows{new Row()};
+    for (size_t i = 1; i < depth; i++) {
+        rows.push_back(new Row());
+        rows[i - 1]->Add(rows[i]);
+    }
+    rows.back()->Add(new Character('z'));
+    flat.Build(rows[0]);
+    bool deep = flat.Size() == depth + 1 && flat.Depth(depth) == depth;
+    for (size_t i = 0; i + 1 < depth; i++) {
+        rows[i]->Remove(0);
+    }
+    for (Row* row : rows) {
+        delete row;
+    }
+    if (!deep) {
+        std::cout << "flat tree loses depth on a chain of " << depth << " rows" << std::endl;
+        return false;
+    }
+    std::cout << "flat tree edits match rebuilds on " << trees << " random trees" << std::endl;
+    return true;
+}
+
+// Сверяет ParallelGlyphReducer и ParallelForEach с последовательным обходом
+bool CheckReducer(size_t trees) {
+    std::mt19937 random(2026);
+    std::vector<TraversalFrame> frames;
+    ParallelGlyphReducer<OrderedHash> single(1);
+    ParallelGlyphReducer<OrderedHash> reducer(4);
+    ParallelGlyphReducer<NoResult> visitor(4);
+    for (size_t t = 0; t < trees; t++) {
+        // Изредка дерево покрупнее, чтобы задачи успевали красть
+        Row* root = t % 50 == 0 ? BuildTree(8, 6) : BuildRandomTree(random, 1 + random() % 6);
+        OrderedHash expected{0, 1, 0};
+        ForEachPreorder(root, frames, [&](Glyph* glyph) {
+            expected = CombineHashes(expected, HashGlyph(glyph));
+        });
+        auto map = [](Glyph* glyph) { return HashGlyph(glyph); };
+        auto combine = [](OrderedHash a, OrderedHash b) { return CombineHashes(a, b); };
+        bool match = true;
+        for (ParallelGlyphReducer<OrderedHash>* r : {&single, &reducer}) {
+            OrderedHash hash = r->Reduce(root, OrderedHash{0, 1, 0}, map, combine);
+            match = match && hash.hash == expected.hash && hash.count == expected.count;
+        }
+        std::atomic<size_t> visited{0};
+        ParallelForEach(visitor, root, [&visited](Glyph*) { visited.fetch_add(1, std::memory_order_relaxed); });
+        match = match && visited.load() == expected.count;
+        delete root;
+        if (!match) {
+            std::cout << "parallel reduction differs from a serial walk on tree " << t << std::endl;
+            return false;
+        }
+    }
+    std::cout << "parallel reductions match serial walks on " << trees << " random trees" << std::endl;
+    return true;
+}
+
+template <typename Walk>
+void TimeTraversal(const char* name, Walk&& walk) {
+    auto begin = std::chrono::steady_clock::now();
+    size_t visited = walk();
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+    std::cout << name << ": " << visited << " nodes in " << ms << " ms ("
+              << visited / ms / 1e3 << " M nodes/s)" << std::endl;
+}
+
+void RunBenchmark() {
+    // 12 потомков, из них 3 строки: около 10^7 узлов при глубине 13
+    Row* root = BuildTree(12, 13);
+
+    TimeTraversal("PreorderIterator", [root] {
+        size_t count = 0;
+        PreorderIterator<Glyph*> iterator(root);
+        for (iterator.First(); !iterator.IsDone(); iterator.Next()) {
+            count += iterator.CurrentItem() != nullptr;
+        }
+        return count;
+    });
+
+    StackPreorderIterator stackIterator(root);
+    TimeTraversal("StackPreorderIterator", [&stackIterator] {
+        size_t count = 0;
+        for (stackIterator.First(); !stackIterator.IsDone(); stackIterator.Next()) {
+            count += stackIterator.CurrentItem() != nullptr;
+        }
+        return count;
+    });
+
+    std::vector<TraversalFrame> frames;
+    TimeTraversal("ForEachPreorder", [root, &frames] {
+        size_t count = 0;
+        ForEachPreorder(root, frames, [&count](Glyph* glyph) { count += glyph != nullptr; });
+        return count;
+    });
+
+    FlatGlyphTree flat;
+    auto begin = std::chrono::steady_clock::now();
+    flat.Build(root);
+    auto end = std::chrono::steady_clock::now();
+    double buildMs = std::chrono::duration<double, std::milli>(end - begin).count();
+    std::cout << "FlatGlyphTree::Build: " << buildMs << " ms" << std::endl;
+
+    TimeTraversal("FlatGlyphTree::ForEach", [&flat] {
+        size_t count = 0;
+        flat.ForEach([&count](Glyph* glyph) { count += glyph != nullptr; });
+        return count;
+    });
+
+    // Анализ по столбцу: листья считаются без обращения к самим глифам
+    TimeTraversal("leaves, ForEachPreorder", [root, &frames] {
+        size_t leaves = 0;
+        ForEachPreorder(root, frames, [&leaves](Glyph* glyph) { leaves += glyph->Children() == nullptr; });
+        return leaves;
+    });
+    TimeTraversal("leaves, flat kinds scan", [&flat] {
+        size_t leaves = 0;
+        const std::vector<uint8_t>& kinds = flat.Kinds();
+        for (size_t i = 1; i < kinds.size(); i++) {
+            leaves += kinds[i] == FlatGlyphTree::kLeaf;
+        }
+        return leaves;
+    });
+
+    // Правки: вставка и удаление маленькой строки в случайных местах
+    std::mt19937 random(42);
+    const size_t edits = 200;
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < edits; i++) {
+        size_t row = random() % flat.Size();
+        while (flat.KindAt(row) != FlatGlyphTree::kRow) {
+            row--;
+        }
+        Row* inserted = new Row();
+        inserted->Add(new Character('x'));
+        inserted->Add(new Character('y'));
+        size_t children = flat.GlyphAt(row)->Children()->size();
+        flat.Insert(row, random() % (children + 1), inserted);
+
+        size_t victim = 1 + random() % (flat.Size() - 1);
+        flat.Remove(victim);
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << edits << " insert+remove patches: "
+              << std::chrono::duration<double, std::milli>(end - begin).count() / edits
+              << " ms each, rebuild " << buildMs << " ms" << std::endl;
+
+    // Хеш документа и число узлов, сверенные с последовательным обходом
+    auto map = [](Glyph* glyph) { return HashGlyph(glyph); };
+    auto combine = [](OrderedHash a, OrderedHash b) { return CombineHashes(a, b); };
+    OrderedHash serial{0, 1, 0};
+    TimeTraversal("hash, ForEachPreorder", [&] {
+        OrderedHash hash{0, 1, 0};
+        ForEachPreorder(root, frames, [&](Glyph* glyph) {
+            hash = combine(hash, map(glyph));
+        });
+        serial = hash;
+        return hash.count;
+    });
+    for (size_t threads : {1, 2, 4, 8}) {
+        // Потоки создаются вне замера и служат всем вызовам Reduce
+        ParallelGlyphReducer<OrderedHash> reducer(threads);
+        std::string name = "hash, ParallelGlyphReducer x" + std::to_string(threads);
+        for (int repeat = 0; repeat < 2; repeat++) {
+            TimeTraversal(name.c_str(), [&] {
+                OrderedHash hash = reducer.Reduce(root, OrderedHash{0, 1, 0}, map, combine);
+                if (hash.hash != serial.hash || hash.count != serial.count) {
+                    std::cout << "hash mismatch" << std::endl;
+                }
+                return hash.count;
+            });
+        }
+    }
+
+    // Перекос: почти всё дерево под первой строкой корня. Кража задач
+    // должна разнести её поддерево по потокам, а результат - совпасть
+    // с последовательным
+    {
+        Row* skewed = new Row();
+        skewed->Add(BuildTree(12, 11));
+        for (int i = 0; i < 11; i++) {
+            skewed->Add(new Character('z'));
+        }
+        OrderedHash expected{0, 1, 0};
+        ForEachPreorder(skewed, frames, [&](Glyph* glyph) {
+            expected = combine(expected, map(glyph));
+        });
+        ParallelGlyphReducer<OrderedHash> reducer(4);
+        OrderedHash hash = reducer.Reduce(skewed, OrderedHash{0, 1, 0}, map, combine);
+        std::cout << "skewed tree x" << reducer.Threads() << ": " << hash.count << " nodes"
+                  << (hash.hash == expected.hash && hash.count == expected.count ? "" : " (MISMATCH)")
+                  << ", per thread";
+        for (size_t i = 0; i < reducer.Threads(); i++) {
+            std::cout << ' ' << reducer.Visited(i);
+        }
+        std::cout << std::endl;
+        delete skewed;
+    }
+
+    TimeTraversal("leaves, std::ranges::count_if(PreorderView)", [root] {
+        return static_cast<size_t>(std::ranges::count_if(PreorderView(root), [](Glyph* glyph) {
+            return glyph->Children() == nullptr;
+        }));
+    });
+    TimeTraversal("PostorderView", [root] {
+        return static_cast<size_t>(std::ranges::distance(PostorderView(root)));
+    });
+    TimeTraversal("BreadthFirstView", [root] {
+        return static_cast<size_t>(std::ranges::distance(BreadthFirstView(root)));
+    });
+    TimeTraversal("leaves, LeafSpanView", [root] {
+        size_t leaves = 0;
+        for (std::span<Glyph* const> run : LeafSpanView(root)) {
+            leaves += run.size();
+        }
+        return leaves;
+    });
+
+    delete root;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        RunBenchmark();
+        return 0;
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--check") == 0) {
+        bool ok = CheckViews(2000);
+        ok = CheckFlatEdits(1000) && ok;
+        ok = CheckReducer(1000) && ok;
+        return ok ? 0 : 1;
+    }
+
     Row* row = new Row();
     Row* row2 = new Row();
     row2->Add(new Character('D'));
@@ -180,10 +1507,12 @@ int main() {
     row->Add(new Character('B'));
     row->Add(new Character('C'));
 
-    Iterator<Glyph*>* iterator = new PreorderIterator<Glyph*>(row);
+    FdRenderSink out;
+
+    Iterator<Glyph*>* iterator = new StackPreorderIterator(row);
     for (iterator->First(); !iterator->IsDone(); iterator->Next()) {
         Glyph* current = iterator->CurrentItem();
-        current->Draw();
+        current->Draw(out);
     }
 
     delete iterator;
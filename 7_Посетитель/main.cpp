@@ -1,7 +1,22 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Предварительное объявление классов
 class Character;
@@ -66,9 +81,353 @@ public:
     }
 };
 
+// Блочный фильтр Блума: все биты одного слова лежат в одной 64-байтной
+// строке кэша, так что отказ стоит одного промаха по памяти
+class BloomFilter {
+public:
+    void reset(size_t keys, size_t bitsPerKey = 10) {
+        size_t blockCount = std::max<size_t>(1, (keys * bitsPerKey + 511) / 512);
+        blocks.assign(blockCount * kWordsPerBlock, 0);
+    }
+
+    void add(uint64_t hash) {
+        uint64_t* block = blockFor(hash);
+        uint64_t bits = hash;
+        for (int i = 0; i < kProbes; i++) {
+            block[(bits >> 6) & 7] |= uint64_t(1) << (bits & 63);
+            bits >>= 9;
+        }
+    }
+
+    bool mayContain(uint64_t hash) const {
+        const uint64_t* block = blockFor(hash);
+        uint64_t bits = hash;
+        for (int i = 0; i < kProbes; i++) {
+            if (!(block[(bits >> 6) & 7] & (uint64_t(1) << (bits & 63)))) {
+                return false;
+            }
+            bits >>= 9;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t kWordsPerBlock = 8;
+    static constexpr int kProbes = 6;
+
+    std::vector<uint64_t> blocks;
+
+    // Блок выбирается по старшим битам другого перемешивания, чтобы не
+    // зависеть от битов, задающих позиции внутри блока
+    const uint64_t* blockFor(uint64_t hash) const {
+        size_t count = blocks.size() / kWordsPerBlock;
+        uint64_t mixed = hash * 0x9E3779B97F4A7C15ull;
+        return blocks.data() + static_cast<size_t>((static_cast<__uint128_t>(mixed) * count) >> 64) * kWordsPerBlock;
+    }
+
+    uint64_t* blockFor(uint64_t hash) {
+        return const_cast<uint64_t*>(static_cast<const BloomFilter*>(this)->blockFor(hash));
+    }
+};
+
+// Словарь для проверки правописания. Список слов (по слову в строке)
+// отображается в память и не копируется: таблица хранит только смещения
+// слов в нём. Поиск - минимальная совершенная хеш-функция по схеме
+// "хеширование и смещение": слово попадает в корзину, а подобранное для
+// корзины зерно даёт ему собственную ячейку без коллизий. Перед таблицей
+// стоит фильтр Блума, так что большинство незнакомых слов отсекается без
+// обращения к тексту. Поиск не выделяет память.
+class Dictionary {
+public:
+    Dictionary() = default;
+
+    Dictionary(const Dictionary&) = delete;
+    Dictionary& operator=(const Dictionary&) = delete;
+
+    ~Dictionary() {
+        unmap();
+    }
+
+    // Загружает список слов из файла через mmap
+    void load(const char* path) {
+        unmap();
+        owned.clear();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+        mappedSize = static_cast<size_t>(info.st_size);
+        if (mappedSize > 0) {
+            void* data = ::mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw std::system_error(errno, std::generic_category(), "mmap");
+            }
+            mapped = static_cast<const char*>(data);
+            ::madvise(const_cast<char*>(mapped), mappedSize, MADV_WILLNEED);
+        }
+        ::close(fd);
+        build(mapped, mappedSize);
+    }
+
+    // Словарь из слов в памяти, например встроенных
+    void assign(const std::vector<std::string>& words) {
+        unmap();
+        owned.clear();
+        for (const std::string& word : words) {
+            owned += word;
+            owned += '\n';
+        }
+        build(owned.data(), owned.size());
+    }
+
+    bool contains(std::string_view word) const {
+        if (slots.empty()) {
+            return false;
+        }
+        uint64_t hash = hashWord(word);
+        if (!bloom.mayContain(hash)) {
+            return false;
+        }
+        uint64_t keyed = keyedHash(hash);
+        const Slot& slot = slots[slotFor(keyed, seeds[bucketFor(keyed)])];
+        return slot.length == word.size() && std::memcmp(text + slot.offset, word.data(), word.size()) == 0;
+    }
+
+    size_t size() const {
+        return slots.size();
+    }
+
+    // Проходит ли слово фильтр Блума - для оценки доли ложных срабатываний
+    bool bloomMayContain(std::string_view word) const {
+        return bloom.mayContain(hashWord(word));
+    }
+
+private:
+    // Средний размер корзины: меньше - быстрее подбор зёрен, но больше
+    // таблица зёрен
+    static constexpr size_t kBucketSize = 4;
+    // Предел перебора зёрен одной корзины, на ключ словаря: последним
+    // корзинам из одного слова остаётся доля свободных ячеек около 1/n,
+    // так что в среднем им нужно около n попыток
+    static constexpr size_t kSeedAttemptsPerKey = 32;
+    // Если какая-то корзина не уложилась, раскладка повторяется с другим
+    // общим зерном, меняющим и деление на корзины
+    static constexpr int kMaxGlobalSeeds = 8;
+
+    const char* mapped = nullptr;
+    size_t mappedSize = 0;
+    std::string owned;
+    const char* text = nullptr;
+
+    // Ячейка таблицы: где в тексте лежит слово
+    struct Slot {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::vector<uint32_t> seeds;
+    std::vector<Slot> slots;
+    BloomFilter bloom;
+    uint64_t globalSeed = 0;
+
+    void unmap() {
+        if (mapped) {
+            ::munmap(const_cast<char*>(mapped), mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+        }
+    }
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    static uint64_t hashWord(std::string_view word) {
+        uint64_t hash = 0x9E3779B97F4A7C15ull ^ word.size();
+        size_t i = 0;
+        for (; i + 8 <= word.size(); i += 8) {
+            uint64_t chunk;
+            std::memcpy(&chunk, word.data() + i, 8);
+            hash = mix(hash ^ chunk);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, word.data() + i, word.size() - i);
+        return mix(hash ^ tail);
+    }
+
+    static size_t scale(uint64_t value, size_t range) {
+        return static_cast<size_t>((static_cast<__uint128_t>(value) * range) >> 64);
+    }
+
+    // Хеш для раскладки по корзинам и ячейкам; фильтр Блума берёт исходный
+    uint64_t keyedHash(uint64_t hash) const {
+        return mix(hash ^ globalSeed);
+    }
+
+    size_t bucketFor(uint64_t hash) const {
+        return scale(hash, seeds.size());
+    }
+
+    size_t slotFor(uint64_t hash, uint32_t seed) const {
+        return scale(mix(hash ^ (uint64_t(seed) * 0xD6E8FEB86659FD93ull)), slots.size());
+    }
+
+    struct Key {
+        uint64_t hash;
+        uint32_t offset;
+        uint8_t length;
+    };
+
+    void build(const char* data, size_t size) {
+        text = data;
+        slots.clear();
+        seeds.clear();
+        // Ячейка хранит 32-битное смещение слова в тексте
+        if (size > UINT32_MAX) {
+            throw std::runtime_error("Dictionary: word list larger than 4 GiB");
+        }
+        std::vector<Key> keys;
+        for (size_t begin = 0; begin < size;) {
+            const char* newline = static_cast<const char*>(std::memchr(data + begin, '\n', size - begin));
+            size_t end = newline ? static_cast<size_t>(newline - data) : size;
+            size_t length = end - begin;
+            if (length > 0 && data[begin + length - 1] == '\r') {
+                length--;
+            }
+            if (length > UINT8_MAX) {
+                throw std::runtime_error("Dictionary: word longer than 255 bytes at offset " +
+                                         std::to_string(begin));
+            }
+            if (length > 0) {
+                std::string_view word(data + begin, length);
+                keys.push_back({hashWord(word), static_cast<uint32_t>(begin), static_cast<uint8_t>(length)});
+            }
+            begin = end + 1;
+        }
+
+        // Повторы слов отбрасываются; разные слова с одинаковым 64-битным
+        // хешем разделить нельзя
+        std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.hash < b.hash; });
+        size_t unique = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (unique > 0 && keys[unique - 1].hash == keys[i].hash) {
+                const Key& kept = keys[unique - 1];
+                if (kept.length != keys[i].length ||
+                    std::memcmp(data + kept.offset, data + keys[i].offset, kept.length) != 0) {
+                    throw std::runtime_error("Dictionary: 64-bit hash collision");
+                }
+                continue;
+            }
+            keys[unique++] = keys[i];
+        }
+        keys.resize(unique);
+
+        for (int attempt = 0; attempt < kMaxGlobalSeeds; attempt++) {
+            globalSeed = mix(0x243F6A8885A308D3ull + static_cast<uint64_t>(attempt));
+            if (place(keys)) {
+                return;
+            }
+        }
+        slots.clear();
+        seeds.clear();
+        throw std::runtime_error("Dictionary: no perfect hash found");
+    }
+
+    // Раскладывает слова по ячейкам при текущем общем зерне; false, если
+    // для какой-то корзины не нашлось зерна в пределах перебора
+    bool place(const std::vector<Key>& keys) {
+        slots.assign(keys.size(), Slot{0, 0});
+        seeds.assign(std::max<size_t>(1, (keys.size() + kBucketSize - 1) / kBucketSize), 0);
+        bloom.reset(keys.size());
+        if (keys.empty()) {
+            return true;
+        }
+        std::vector<uint64_t> keyed(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            keyed[i] = keyedHash(keys[i].hash);
+        }
+
+        // Корзины обрабатываются от больших к малым, пока таблица ещё
+        // свободна; для каждой подбирается зерно, раскладывающее её слова по
+        // свободным и различным ячейкам
+        std::vector<uint32_t> bucketStart(seeds.size() + 1, 0);
+        for (uint64_t hash : keyed) {
+            bucketStart[bucketFor(hash) + 1]++;
+        }
+        for (size_t b = 0; b < seeds.size(); b++) {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+        std::vector<uint32_t> byBucket(keys.size());
+        std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t i = 0; i < keys.size(); i++) {
+            byBucket[fill[bucketFor(keyed[i])]++] = static_cast<uint32_t>(i);
+        }
+        std::vector<uint32_t> order(seeds.size());
+        for (size_t b = 0; b < order.size(); b++) {
+            order[b] = static_cast<uint32_t>(b);
+        }
+        std::sort(order.begin(), order.end(), [&bucketStart](uint32_t a, uint32_t b) {
+            return bucketStart[a + 1] - bucketStart[a] > bucketStart[b + 1] - bucketStart[b];
+        });
+
+        size_t maxSeeds = std::min<size_t>(UINT32_MAX, 1024 + kSeedAttemptsPerKey * keys.size());
+        std::vector<uint8_t> taken(keys.size(), 0);
+        std::vector<size_t> placed;
+        for (uint32_t bucket : order) {
+            size_t first = bucketStart[bucket];
+            size_t last = bucketStart[bucket + 1];
+            if (first == last) {
+                break;
+            }
+            for (uint32_t seed = 0;; seed++) {
+                if (seed == maxSeeds) {
+                    return false;
+                }
+                placed.clear();
+                bool fits = true;
+                for (size_t i = first; i < last && fits; i++) {
+                    size_t slot = slotFor(keyed[byBucket[i]], seed);
+                    fits = !taken[slot] && std::find(placed.begin(), placed.end(), slot) == placed.end();
+                    placed.push_back(slot);
+                }
+                if (!fits) {
+                    continue;
+                }
+                seeds[bucket] = seed;
+                for (size_t i = first; i < last; i++) {
+                    const Key& key = keys[byBucket[i]];
+                    size_t slot = placed[i - first];
+                    taken[slot] = 1;
+                    slots[slot] = {key.offset, key.length};
+                    bloom.add(key.hash);
+                }
+                break;
+            }
+        }
+        return true;
+    }
+};
+
 // Конкретный Visitor для проверки правописания
 class SpellingChecker : public Visitor {
 public:
+    // Без словаря слова проверяются по встроенному списку
+    SpellingChecker() : dictionary(&builtinDictionary()) {}
+
+    explicit SpellingChecker(const Dictionary& dictionary) : dictionary(&dictionary) {}
+
     void visitCharacter(Character* character) override {
         char ch = character->getCharCode();
         if (isalpha(ch)) {
@@ -98,14 +457,21 @@ public:
     }
 
 private:
+    const Dictionary* dictionary;
     std::string currentWord;
     std::vector<std::string> misspellings;
 
+    static const Dictionary& builtinDictionary() {
+        static const Dictionary* dictionary = [] {
+            Dictionary* builtin = new Dictionary();
+            builtin->assign({"the", "quick", "brown", "fox"});
+            return builtin;
+        }();
+        return *dictionary;
+    }
+
     bool isMisspelled(const std::string& word) {
-        // Простая проверка на наличие слова в словаре
-        // В реальной реализации здесь будет более сложная логика
-        std::vector<std::string> dictionary = {"the", "quick", "brown", "fox"};
-        return std::find(dictionary.begin(), dictionary.end(), word) == dictionary.end();
+        return !dictionary->contains(word);
     }
 };
 
@@ -144,7 +510,102 @@ private:
     }
 };
 
-int main() {
+// Случайное слово из строчных латинских букв длиной от 3 до 12
+std::string randomWord(std::mt19937_64& random) {
+    std::string word(3 + random() % 10, 'a');
+    for (char& ch : word) {
+        ch = static_cast<char>('a' + random() % 26);
+    }
+    return word;
+}
+
+void runBenchmark(size_t words, size_t lookups) {
+    const char* path = "words.bench.txt";
+    std::mt19937_64 random(7);
+    std::vector<std::string> list;
+    list.reserve(words);
+    {
+        std::ofstream out(path);
+        for (size_t i = 0; i < words; i++) {
+            list.push_back(randomWord(random));
+            out << list.back() << '\n';
+        }
+    }
+
+    Dictionary dictionary;
+    auto begin = std::chrono::steady_clock::now();
+    dictionary.load(path);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "Dictionary::load: " << dictionary.size() << " words in "
+              << std::chrono::duration<double, std::milli>(end - begin).count() << " ms" << std::endl;
+
+    // Запросы: половина слов из словаря, половина случайных
+    std::vector<std::string> queries;
+    queries.reserve(lookups);
+    for (size_t i = 0; i < lookups; i++) {
+        queries.push_back(i % 2 ? list[random() % list.size()] : randomWord(random));
+    }
+
+    begin = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (const std::string& query : queries) {
+        found += dictionary.contains(query);
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "Dictionary::contains: " << found << " of " << lookups << " found, "
+              << std::chrono::duration<double, std::nano>(end - begin).count() / lookups << " ns per lookup" << std::endl;
+
+    std::unordered_set<std::string_view> set(list.begin(), list.end());
+    begin = std::chrono::steady_clock::now();
+    found = 0;
+    for (const std::string& query : queries) {
+        found += set.count(query);
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "std::unordered_set: " << found << " of " << lookups << " found, "
+              << std::chrono::duration<double, std::nano>(end - begin).count() / lookups << " ns per lookup" << std::endl;
+
+    size_t absent = 0;
+    size_t passed = 0;
+    for (size_t i = 0; i < lookups; i += 2) {
+        if (!set.count(queries[i])) {
+            absent++;
+            passed += dictionary.bloomMayContain(queries[i]);
+        }
+    }
+    std::cout << "Bloom filter passes " << 100.0 * passed / absent << "% of unknown words" << std::endl;
+
+    std::remove(path);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        runBenchmark(600000, 5000000);
+        return 0;
+    }
+
+    // Словарь из файла, если он указан: --dict <список слов>
+    // Ошибка чтения или пустой список - повод остановиться, а не молча
+    // проверять текст встроенным словарём
+    Dictionary fileDictionary;
+    bool useFileDictionary = argc > 1 && std::strcmp(argv[1], "--dict") == 0;
+    if (useFileDictionary) {
+        if (argc < 3) {
+            std::cerr << "usage: " << argv[0] << " --dict <word list>" << std::endl;
+            return 2;
+        }
+        try {
+            fileDictionary.load(argv[2]);
+        } catch (const std::exception& e) {
+            std::cerr << "cannot load dictionary: " << e.what() << std::endl;
+            return 1;
+        }
+        if (fileDictionary.size() == 0) {
+            std::cerr << "dictionary " << argv[2] << " has no words" << std::endl;
+            return 1;
+        }
+    }
+
     // Создаем структуру документа
     Row* row = new Row();
     row->addGlyph(new Character('T'));
@@ -169,7 +630,7 @@ int main() {
     row->addGlyph(new Character('.'));
 
     // Проверка правописания
-    SpellingChecker spellingChecker;
+    SpellingChecker spellingChecker = useFileDictionary ? SpellingChecker(fileDictionary) : SpellingChecker();
     row->accept(spellingChecker);
 
     std::cout << "Misspelled words:" << std::endl;